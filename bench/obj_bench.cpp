@@ -0,0 +1,263 @@
+// microbenchmark for the obj loader, run as
+//   obj-bench [file.obj]
+// without a file a synthetic mesh is generated in memory. the parse rate is
+// printed next to a plain memcpy of the same bytes for reference, normal
+// generation next to the std::map accumulator it replaced and to an incremental
+// update after a few vertices moved, checked against a full recompute. the last part runs
+// normal generation over the mesh in file order, shuffled and morton ordered
+// to show what memory order alone does to it
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/util/obj.h"
+#include "../src/util/normals.h"
+#include "../src/util/spatial_order.h"
+#include "../src/util/vertex_cache.h"
+
+static double gs_dMinSeconds = 0.5;
+
+template<typename F>
+double Time(F&& fn)
+{
+	// repeat until the run is long enough to be measurable, report the best pass
+	double best = 1e30;
+	double total = 0;
+	int runs = 0;
+	while (total < gs_dMinSeconds || runs < 3)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = std::min(best, t);
+		total += t;
+		runs++;
+	}
+	return best;
+}
+
+static std::string GenerateObj(size_t numVertices)
+{
+	std::string text;
+	char line[128];
+	srand(1);
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		int n = snprintf(line, sizeof(line), "v %f %f %f\n",
+			rand() / (float)RAND_MAX * 2 - 1, rand() / (float)RAND_MAX * 2 - 1, rand() / (float)RAND_MAX * 2 - 1);
+		text.append(line, n);
+	}
+	for (size_t i = 0; i + 2 < numVertices; i++)
+	{
+		int n = snprintf(line, sizeof(line), "f %zu %zu %zu\n", i + 1, i + 2, i + 3);
+		text.append(line, n);
+	}
+	return text;
+}
+
+// the tokenizer LoadObj used to have: copy each token, terminate it and call atof/atoi
+static void ParseLegacy(const char* begin, const char* end, std::vector<float>& vertices, std::vector<uint32_t>& indices)
+{
+	Util::ForEachLine(begin, end, [&](const char* lineBegin, const char* lineEnd)
+	{
+		if (lineBegin == lineEnd || (*lineBegin != 'v' && *lineBegin != 'f'))
+			return;
+		char buff[32];
+		const char* p = lineBegin + 1;
+		while ((p = Util::SkipSpaces(p, lineEnd)) < lineEnd)
+		{
+			const char* tStart = p;
+			p = Util::SkipToken(p, lineEnd);
+			size_t len = std::min<size_t>(p - tStart, sizeof(buff) - 1);
+			memcpy(buff, tStart, len);
+			buff[len] = '\0';
+			if (*lineBegin == 'v')
+				vertices.push_back(atof(buff));
+			else
+				indices.push_back(atoi(buff) - 1);
+			memset(buff, 0, sizeof(buff));
+		}
+	});
+}
+
+// the normal generation GenerateNormals used to do: a std::map of face normal lists per vertex
+static std::vector<float> NormalsLegacy(const std::vector<float>& vertices, const std::vector<uint32_t>& indices)
+{
+	std::map<uint32_t, std::vector<std::array<float, 3>>> normals;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const float* p1 = &vertices[indices[i] * 3];
+		const float* p2 = &vertices[indices[i + 1] * 3];
+		const float* p3 = &vertices[indices[i + 2] * 3];
+		float a[3] = {p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2]};
+		float b[3] = {p3[0] - p1[0], p3[1] - p1[1], p3[2] - p1[2]};
+		std::array<float, 3> n = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+		for (int k = 0; k < 3; k++)
+			normals[indices[i + k]].push_back(n);
+	}
+	std::vector<float> out;
+	for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+	{
+		out.insert(out.end(), &vertices[i], &vertices[i] + 3);
+		float n[3] = {0, 0, 0};
+		std::vector<std::array<float, 3>> ns = normals[i / 3];
+		for (auto& f : ns)
+		{
+			n[0] += f[0];
+			n[1] += f[1];
+			n[2] += f[2];
+		}
+		out.insert(out.end(), n, n + 3);
+	}
+	return out;
+}
+
+static void Report(const char* name, double seconds, size_t bytes)
+{
+	printf("%-28s %8.2f ms %8.1f MB/s\n", name, seconds * 1000, bytes / seconds / (1024 * 1024));
+}
+
+// normals on one thread, so only the memory order differs, with the acmr of a gpu vertex cache
+static void ReportOrder(const char* name, const Util::Mesh& mesh)
+{
+	Util::VertexCacheStats stats = Util::AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.VertexCount());
+	double seconds = Time([&] { Util::GenerateNormals(mesh.positions, mesh.indices); });
+	printf("%-28s %8.2f ms ACMR %.3f\n", name, seconds * 1000, stats.acmr);
+}
+
+// the triangles and the vertices of mesh in a random order
+static Util::Mesh Shuffle(const Util::Mesh& mesh)
+{
+	std::mt19937 rng(1);
+	std::vector<uint32_t> triangles(mesh.TriangleCount());
+	std::iota(triangles.begin(), triangles.end(), 0);
+	std::shuffle(triangles.begin(), triangles.end(), rng);
+	std::vector<uint32_t> vertices(mesh.VertexCount());
+	std::iota(vertices.begin(), vertices.end(), 0);
+	std::shuffle(vertices.begin(), vertices.end(), rng);
+
+	Util::Mesh out = mesh;
+	for (size_t v = 0; v < vertices.size(); v++)
+		std::copy(&mesh.positions[v * 3], &mesh.positions[v * 3] + 3, &out.positions[vertices[v] * 3]);
+	out.normals.clear();
+	out.texCoords.clear();
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		for (int k = 0; k < 3; k++)
+			out.indices[t * 3 + k] = vertices[mesh.indices[triangles[t] * 3 + k]];
+	}
+	out.submeshes.assign(1, Util::Submesh());
+	out.submeshes[0].indexCount = out.indices.size();
+	return out;
+}
+
+int main(int argc, char** argv)
+{
+	std::string text;
+	Util::MappedFile file;
+	const char* begin;
+	const char* end;
+	if (argc > 1)
+	{
+		if (!file.Open(argv[1]))
+		{
+			fprintf(stderr, "failed to map %s\n", argv[1]);
+			return 1;
+		}
+		begin = file.Data();
+		end = file.End();
+	}
+	else
+	{
+		text = GenerateObj(1000000);
+		begin = text.data();
+		end = begin + text.size();
+	}
+	size_t bytes = end - begin;
+	printf("%.1f MB of obj text\n", bytes / (1024.0 * 1024.0));
+
+	std::vector<char> copy(bytes);
+	Report("memcpy", Time([&] { memcpy(copy.data(), begin, bytes); }), bytes);
+
+	Report("legacy copy + atof", Time([&]
+	{
+		std::vector<float> vertices;
+		std::vector<uint32_t> indices;
+		ParseLegacy(begin, end, vertices, indices);
+	}), bytes);
+
+	Util::SetThreadCount(1);
+	Report("from_chars, 1 thread", Time([&] { Util::ParseObjData(begin, end); }), bytes);
+
+	Util::SetThreadCount(0);
+	if (Util::GetThreadPool().NumThreads() > 1)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "from_chars, %u threads", Util::GetThreadPool().NumThreads());
+		Report(name, Time([&] { Util::ParseObjData(begin, end); }), bytes);
+	}
+
+	Util::Mesh mesh = Util::BuildMesh(Util::ParseObjData(begin, end));
+	size_t vertexBytes = mesh.positions.size() * sizeof(float);
+	printf("\n%zu vertices, %zu triangles\n", mesh.VertexCount(), mesh.TriangleCount());
+	Report("normals, std::map", Time([&] { NormalsLegacy(mesh.positions, mesh.indices); }), vertexBytes);
+
+	Util::SetThreadCount(1);
+	Report("normals, 1 thread", Time([&] { Util::GenerateNormals(mesh.positions, mesh.indices); }), vertexBytes);
+
+	Util::SetThreadCount(0);
+	if (Util::GetThreadPool().NumThreads() > 1)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "normals, %u threads", Util::GetThreadPool().NumThreads());
+		Report(name, Time([&] { Util::GenerateNormals(mesh.positions, mesh.indices); }), vertexBytes);
+	}
+
+	// move a few vertices, the incremental update has to land on what a full recompute gives
+	std::vector<float> moved = mesh.positions;
+	std::vector<uint32_t> dirty;
+	std::mt19937 rng(1);
+	for (int i = 0; i < 100 && mesh.VertexCount(); i++)
+	{
+		uint32_t v = rng() % mesh.VertexCount();
+		for (int c = 0; c < 3; c++)
+			moved[v * 3 + c] += (rng() % 1000) / 1000.0f - 0.5f;
+		dirty.push_back(v);
+	}
+	Util::IncrementalNormals incremental;
+	incremental.Build(mesh.positions, mesh.indices);
+	double updateSeconds = Time([&]
+	{
+		incremental.MarkDirty(dirty.data(), dirty.size());
+		incremental.Update(moved);
+	});
+	std::vector<float> full = Util::ComputeVertexNormals(moved, mesh.indices);
+	float maxDifference = 0;
+	for (size_t i = 0; i < full.size(); i++)
+		maxDifference = std::max(maxDifference, std::fabs(full[i] - incremental.Normals()[i]));
+	printf("%-28s %8.3f ms, %zu vertices moved, max difference %g\n", "normals, incremental", updateSeconds * 1000, dirty.size(), maxDifference);
+
+	Util::Mesh shuffled = Shuffle(mesh);
+	Util::Mesh sorted = shuffled;
+	size_t indexBytes = mesh.indices.size() * sizeof(uint32_t);
+	Report("morton sort", Time([&]
+	{
+		sorted = shuffled;
+		Util::SpatialOrderMesh(sorted);
+	}), indexBytes);
+
+	printf("\n");
+	Util::SetThreadCount(1);
+	ReportOrder("normals, file order", mesh);
+	ReportOrder("normals, shuffled", shuffled);
+	ReportOrder("normals, morton order", sorted);
+	Util::SetThreadCount(0);
+	return 0;
+}
@@ -6,6 +6,11 @@
 #include <unistd.h>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
 #include "util/util.h"
 
 #include <imgui.h>
@@ -13,7 +18,57 @@
 #include <imgui_impl_opengl3.h>
 
 
-uint32_t CreateShader(char* vss, char *fss);
+// the gl objects of the model being drawn
+struct GpuMesh
+{
+	uint32_t vao = 0;
+	uint32_t vbo = 0;
+	uint32_t ebo = 0;
+	size_t vertexBytes = 0;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	uint32_t indexSize = 4;
+	uint32_t layout = 0;
+	float positionScale[3] = {1, 1, 1};
+	float positionOffset[3] = {0, 0, 0};
+};
+
+// the std140 uniform blocks of the phong program, these have to match the shaders' Frame and
+// Object blocks member for member. vec3s are padded out to vec4s
+constexpr uint32_t FRAME_BLOCK_BINDING = 0;
+constexpr uint32_t OBJECT_BLOCK_BINDING = 1;
+
+struct FrameBlock
+{
+	glm::vec4 cameraPosition;
+	glm::vec4 lightPosition;
+	glm::vec4 lightColor;
+};
+
+// the transform with one material, a new one for every material that gets drawn
+struct ObjectBlock
+{
+	glm::mat4 mvp;
+	glm::mat4 model;
+	glm::vec4 objectColor;
+	float ambient;
+	float specular;
+	float roughness;
+	float padding;
+};
+
+// the uniforms the vertex layouts decode with, every layout's program has its own handles
+struct DecodeUniforms
+{
+	Util::Uniform<glm::vec3> positionScale;
+	Util::Uniform<glm::vec3> positionOffset;
+};
+
+GpuMesh UploadMesh(const float* vertices, size_t vertexBytes, const uint32_t* indices, size_t indexCount, uint32_t layout);
+GpuMesh UploadMesh(const Util::MeshCache& model, uint32_t layout);
+bool UpdateMesh(GpuMesh& mesh, const Util::MeshCache& from, const Util::MeshCache& to, size_t& uploaded);
+void DeleteMesh(GpuMesh& mesh);
+std::vector<std::string> FindModels(const char* directory);
 
 static uint32_t gs_iScreenWidth = 800;
 static uint32_t gs_iScreenHeight = 600;
@@ -22,8 +77,8 @@ uint32_t vpT, vpD, vpFbo;
 static glm::mat4 gs_mProjectionMat;
 void WindowSizeChanged(GLFWwindow* window, int w, int h)
 {
-	uint32_t gs_iScreenWidth = w;
-	uint32_t gs_iScreenHeight = h;
+	gs_iScreenWidth = w;
+	gs_iScreenHeight = h;
 	gs_mProjectionMat = glm::perspective((float)M_PI/4.0f, (float)w/h, 0.1f, 1000.0f);
 	glViewport(0, 0, w, h);
 
@@ -75,64 +130,78 @@ int main()
 	glEnable(GL_DEPTH_TEST);
 	glViewport(0, 0, gs_iScreenWidth, gs_iScreenHeight);
 
-	// load the model
-	std::pair<std::vector<float>, std::vector<uint32_t>> model = Util::LoadObj("assets/gear.obj");
-	model.first = Util::GenerateNormals(model.first, model.second);
-	const char* vss = "#version 330 core\n"
-		"layout (location = 0) in vec3 aPos;"
-		"layout (location = 1) in vec3 aNormal;"
-		"uniform mat4 MVP;"
-		"uniform mat4 model;"
+	// the model loads in the background, until it is ready nothing is drawn
+	std::vector<std::string> models = FindModels("assets");
+	Util::AsyncMeshLoader loader;
+	loader.Request("assets/gear.obj");
+	GpuMesh mesh;
+	std::unique_ptr<Util::MeshCache> model;
+	std::string modelPath;
+	size_t lastReloadBytes = 0;
+
+	// reloads the model when its obj, mtl or cache changes on disk
+	Util::FileWatcher watcher;
+	// the inputs and their decoding come from each vertex layout, see Util::Layout
+	const char* blocks =
+		"layout(std140) uniform Frame {"
+		"	vec4 cameraPosition;"
+		"	vec4 lightPosition;"
+		"	vec4 lightColor;"
+		"};"
+		"layout(std140) uniform Object {"
+		"	mat4 MVP;"
+		"	mat4 model;"
+		"	vec4 objectColor;"
+		"	float ambient;"
+		"	float specular;"
+		"	float roughness;"
+		"};";
+	const char* vss =
 		"out vec3 normal;"
 		"out vec3 fragPos;"
 		"void main() {"
-		"	gl_Position = MVP * vec4(aPos, 1);"
-		"	fragPos = vec3(model * vec4(aPos, 1));"
-		"	normal = aNormal;"
+		"	vec3 position = DecodePosition();"
+		"	gl_Position = MVP * vec4(position, 1);"
+		"	fragPos = vec3(model * vec4(position, 1));"
+		"	normal = normalize(DecodeNormal());"
 		"}";
-	const char* fss = "#version 330 core\n"
+	const char* fss =
 		"in vec3 normal;"
 		"in vec3 fragPos;"
 		"out vec4 color;"
-		"uniform vec3 lightPosition;"
-		"uniform vec3 cameraPosition;"
-		"uniform vec4 lightColor;"
-		"uniform vec4 objectColor;"
-		"uniform float ambient;"
-		"uniform float specular;"
-		"uniform float roughness;"
 		"void main() {"
 		"	vec4 aColor = ambient * lightColor;"
-		"	vec3 lightDirection = normalize(lightPosition - fragPos);"
+		"	vec3 lightDirection = normalize(lightPosition.xyz - fragPos);"
 		"	vec4 dColor = (1 - specular) * max(0, dot(normal, lightDirection)) * lightColor;"
 		"	vec3 halfVec = reflect(-lightDirection, normal);"
-		"	vec3 viewDirection = normalize(cameraPosition - fragPos);"
+		"	vec3 viewDirection = normalize(cameraPosition.xyz - fragPos);"
 		"	float spec = pow(max(0, dot(viewDirection, halfVec)), (1 - roughness)*32);"
 		"	vec4 sColor = specular * spec * lightColor;"
 		"	color = (aColor + dColor + sColor) * objectColor;"
 		"}";
 
-	uint32_t vao, vbo, ebo;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	glGenBuffers(1, &vbo);
-	glGenBuffers(1, &ebo);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-
-	glBufferData(GL_ARRAY_BUFFER, model.first.size() * sizeof(float), model.first.data(), GL_STATIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.second.size() * 4, model.second.data(), GL_STATIC_DRAW);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), nullptr);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-
-	uint32_t program = CreateShader((char*)vss, (char*)fss);
+	// per frame and per object uniform blocks, written while the gpu reads earlier frames
+	Util::UniformRing uniformRing;
 
-	glUseProgram(program);
+	// one program per vertex layout
+	std::vector<Util::ShaderProgram> programs(Util::GetVertexLayouts().size());
+	std::vector<DecodeUniforms> uniforms(programs.size());
+	std::string fragmentSource = std::string("#version 330 core\n") + blocks + fss;
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		std::string source = "#version 330 core\n" + Util::GetVertexLayouts()[i].shaderInputs + blocks + vss;
+		Util::ShaderProgram& program = programs[i];
+		if (!program.Create(source.c_str(), fragmentSource.c_str()))
+		{
+			std::cout << "No program for the " << Util::GetVertexLayouts()[i].name << " layout" << std::endl;
+			continue;
+		}
+		program.BindBlock("Frame", FRAME_BLOCK_BINDING);
+		program.BindBlock("Object", OBJECT_BLOCK_BINDING);
+		DecodeUniforms& u = uniforms[i];
+		u.positionScale = program.Find<glm::vec3>("positionScale");
+		u.positionOffset = program.Find<glm::vec3>("positionOffset");
+	}
 
 	glm::vec3 cameraPosition(0, 5, 10);
 	glm::vec3 objectPosition(0, 0, 0);
@@ -142,10 +211,36 @@ int main()
 
 	glm::vec3 lightPosition(3, 1, 0);
 	glm::vec4 lightColor(1, 1, 1, 1);
-	glm::vec4 objectColor(1, 1, 1, 1);
-	float ambient = 0.3f;
-	float specular = 0.5f;
-	float roughness = 0;
+
+	// what the vertices are packed as on the gpu, an index into Util::GetVertexLayouts
+	uint32_t layout = Util::DEFAULT_VERTEX_LAYOUT;
+	// one whose program didn't link can't be drawn, start with one that did
+	for (uint32_t i = 0; !programs[layout].Id() && i < programs.size(); i++)
+		layout = i;
+
+	// the model with its normals split at hard edges, one set of buffers per crease angle
+	// that has been looked at so moving the slider back and forth only swaps them
+	constexpr size_t CREASE_CACHE_SIZE = 8;
+	Util::CreaseNormals crease;
+	std::map<int, GpuMesh> creaseMeshes;
+	int creaseAngle = 180;
+
+	// every submesh is drawn at the coarsest lod whose error stays under lodThreshold pixels
+	// on screen. it has to get past the threshold by LOD_HYSTERESIS to switch, so the
+	// lods don't flicker while the camera sits right at the boundary
+	constexpr float LOD_HYSTERESIS = 0.25f;
+	float lodThreshold = 1.0f;
+	std::vector<uint32_t> submeshLods;
+
+	// full detail submeshes are drawn meshlet by meshlet, skipping the ones outside the
+	// frustum. skipping the ones facing away too is opt-in, back faces are drawn otherwise
+	// and an open mesh seen from behind would lose them
+	bool cullMeshlets = true;
+	bool cullBackfacing = false;
+
+	// a copy of the model's materials that the controls edit
+	std::vector<Util::MeshCacheMaterial> materials;
+	int selectedMaterial = 0;
 
 	// for the viewport
 	glGenTextures(1, &vpT);
@@ -172,45 +267,278 @@ int main()
 	while (!glfwWindowShouldClose(window))
 	{
 		glfwPollEvents();
-		modelMat = glm::translate(glm::mat4(1), objectPosition);
-		glm::mat4 modelViewProjectionMat = gs_mProjectionMat * viewMat * modelMat;
-
-		// set the uniforms
-		int32_t mvpLocation = glGetUniformLocation(program, "MVP");
-		glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(modelViewProjectionMat));
-
-		int32_t modelLocation = glGetUniformLocation(program, "model");
-		glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(modelMat));
-
-		int32_t lightPositionLocation = glGetUniformLocation(program, "lightPosition");
-		glUniform3f(lightPositionLocation, lightPosition.x, lightPosition.y, lightPosition.z);
-
-		int32_t cameraPositionLocation = glGetUniformLocation(program, "cameraPosition");
-		glUniform3f(cameraPositionLocation, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-		int32_t lightColorLocation = glGetUniformLocation(program, "lightColor");
-		glUniform4f(lightColorLocation, lightColor.x, lightColor.y, lightColor.z, lightColor.w);
-
-		int32_t objectColorLocation = glGetUniformLocation(program, "objectColor");
-		glUniform4f(objectColorLocation, objectColor.x, objectColor.y, objectColor.z, objectColor.w);
 
-		int32_t ambientLocation = glGetUniformLocation(program, "ambient");
-		glUniform1f(ambientLocation, ambient);
+		if (watcher.Poll() && !modelPath.empty())
+			loader.Request(modelPath);
+
+		// swap in a finished model, the old one is drawn right up to this point
+		if (std::unique_ptr<Util::MeshCache> loaded = loader.Poll())
+		{
+			if (loaded->IsOpen())
+			{
+				// the same model changed on disk, when the sizes still match only upload what differs
+				if (!model || loader.Loaded() != modelPath || !UpdateMesh(mesh, *model, *loaded, lastReloadBytes))
+				{
+					GpuMesh uploaded = UploadMesh(*loaded, layout);
+					DeleteMesh(mesh);
+					mesh = uploaded;
+					lastReloadBytes = mesh.vertexBytes + mesh.indexCount * mesh.indexSize;
+				}
+				model = std::move(loaded);
+				modelPath = loader.Loaded();
+
+				crease.Clear();
+				for (auto& entry : creaseMeshes)
+					DeleteMesh(entry.second);
+				creaseMeshes.clear();
+				submeshLods.assign(model->SubmeshCount(), 0);
+
+				watcher.Clear();
+				watcher.Watch(modelPath);
+				for (size_t i = 0; i < model->DependencyCount(); i++)
+					watcher.Watch(model->DependencyPath(i));
+
+				materials.assign(model->Materials(), model->Materials() + model->MaterialCount());
+				if (selectedMaterial >= (int)materials.size())
+					selectedMaterial = 0;
+			}
+			else
+				std::cout << "Failed to load " << loader.Loaded() << std::endl;
+		}
 
-		int32_t specularLocation = glGetUniformLocation(program, "specular");
-		glUniform1f(specularLocation, specular);
+		modelMat = glm::translate(glm::mat4(1), objectPosition);
+		glm::mat4 modelViewProjectionMat = gs_mProjectionMat * viewMat * modelMat;
 
-		int32_t roughnessLocation = glGetUniformLocation(program, "roughness");
-		glUniform1f(roughnessLocation, roughness);
+		// the model as uploaded, or split at the crease angle
+		const GpuMesh* drawn = &mesh;
+		if (mesh.indexCount && creaseAngle < 180)
+		{
+			auto found = creaseMeshes.find(creaseAngle);
+			if (found == creaseMeshes.end())
+			{
+				if (!crease.IsBuilt())
+					crease.Build(model->Vertices(), model->VertexCount(), model->VertexStride(), model->Indices(), model->IndexCount());
+				Util::CreaseMesh split = crease.Compute(creaseAngle);
+
+				// drop the angle furthest from this one when there are too many
+				if (creaseMeshes.size() >= CREASE_CACHE_SIZE)
+				{
+					auto furthest = std::max_element(creaseMeshes.begin(), creaseMeshes.end(), [&](const auto& a, const auto& b)
+					{
+						return std::abs(a.first - creaseAngle) < std::abs(b.first - creaseAngle);
+					});
+					DeleteMesh(furthest->second);
+					creaseMeshes.erase(furthest);
+				}
+				GpuMesh uploaded = UploadMesh(split.vertices.data(), split.vertices.size() * sizeof(float), split.indices.data(), split.indices.size(), layout);
+				found = creaseMeshes.emplace(creaseAngle, uploaded).first;
+			}
+			drawn = &found->second;
+		}
+
+		// each layout has its own program. the values only reach gl when they changed,
+		// right before the next draw
+		Util::ShaderProgram& program = programs[drawn->layout];
+		const DecodeUniforms& u = uniforms[drawn->layout];
+		program.Use();
+
+		// the frame block and one object block per material fit in this frame's part of the ring
+		uniformRing.BeginFrame(uniformRing.Align(sizeof(FrameBlock)) + materials.size() * uniformRing.Align(sizeof(ObjectBlock)));
+		FrameBlock frameBlock;
+		frameBlock.cameraPosition = glm::vec4(cameraPosition, 1);
+		frameBlock.lightPosition = glm::vec4(lightPosition, 1);
+		frameBlock.lightColor = lightColor;
+		uniformRing.Push(FRAME_BLOCK_BINDING, frameBlock);
 		glBindFramebuffer(GL_FRAMEBUFFER, vpFbo);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glDrawElements(GL_TRIANGLES, model.second.size(), GL_UNSIGNED_INT, nullptr);
+
+		// the submeshes are sorted by material. each material with anything visible is set once,
+		// then its visible submeshes are drawn, neighbouring ones merged into a single draw
+		size_t submeshesDrawn = 0;
+		size_t drawCalls = 0;
+		size_t trianglesDrawn = 0;
+		size_t meshletsDrawn = 0;
+		size_t meshletsTested = 0;
+		if (drawn->indexCount)
+		{
+			// the cone test needs the camera where the meshlets are
+			glm::vec3 modelCamera = glm::vec3(glm::inverse(modelMat) * glm::vec4(cameraPosition, 1));
+			glBindVertexArray(drawn->vao);
+			program.Set(u.positionScale, glm::make_vec3(drawn->positionScale));
+			program.Set(u.positionOffset, glm::make_vec3(drawn->positionOffset));
+			uint32_t indexType = drawn->indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			const Util::MeshCacheSubmesh* submeshes = model->Submeshes();
+			size_t runStart = 0;
+			size_t runCount = 0;
+			auto flush = [&]()
+			{
+				if (!runCount)
+					return;
+				program.Flush();
+				glDrawElements(GL_TRIANGLES, runCount, indexType, (void*)(runStart * drawn->indexSize));
+				drawCalls++;
+				runCount = 0;
+			};
+
+			for (size_t i = 0; i < model->SubmeshCount();)
+			{
+				uint32_t materialIndex = submeshes[i].material;
+				bool bound = false;
+				for (; i < model->SubmeshCount() && submeshes[i].material == materialIndex; i++)
+				{
+					const Util::MeshCacheSubmesh& submesh = submeshes[i];
+					if (!Util::BoxInFrustum(modelViewProjectionMat, submesh.boundsMin, submesh.boundsMax))
+						continue;
+					if (!bound)
+					{
+						const Util::MeshCacheMaterial& material = materials[materialIndex];
+						ObjectBlock objectBlock;
+						objectBlock.mvp = modelViewProjectionMat;
+						objectBlock.model = modelMat;
+						objectBlock.objectColor = glm::make_vec4(material.color);
+						objectBlock.ambient = material.ambient;
+						objectBlock.specular = material.specular;
+						objectBlock.roughness = material.roughness;
+						objectBlock.padding = 0;
+						uniformRing.Push(OBJECT_BLOCK_BINDING, objectBlock);
+						bound = true;
+					}
+
+					// the lods sit behind the model's own indices. a crease split has its own
+					// vertices that they don't index, it's always drawn in full
+					size_t first = submesh.firstIndex;
+					size_t count = submesh.indexCount;
+					bool fullDetail = true;
+					if (drawn == &mesh && model->LodCount() > 1)
+					{
+						glm::vec3 boundsMin = glm::make_vec3(submesh.boundsMin);
+						glm::vec3 boundsMax = glm::make_vec3(submesh.boundsMax);
+						glm::vec3 center = glm::vec3(modelMat * glm::vec4((boundsMin + boundsMax) * 0.5f, 1));
+						float distance = std::max(glm::length(center - cameraPosition) - glm::length(boundsMax - boundsMin) * 0.5f, 0.1f);
+						// how many pixels one unit covers at the closest point of the submesh
+						float pixelsPerUnit = gs_mProjectionMat[1][1] * gs_iScreenHeight * 0.5f / distance;
+
+						float errors[Util::LOD_MAX_LEVELS] = {0};
+						for (uint32_t level = 1; level < model->LodCount(); level++)
+							errors[level] = model->Lod(level, i).error;
+						submeshLods[i] = Util::SelectLod(errors, model->LodCount(), pixelsPerUnit, submeshLods[i], lodThreshold, LOD_HYSTERESIS);
+						if (submeshLods[i] > 0)
+						{
+							const Util::LodRange& lod = model->Lod(submeshLods[i], i);
+							first = model->IndexCount() + lod.firstIndex;
+							count = lod.indexCount;
+							fullDetail = false;
+						}
+					}
+
+					auto append = [&](size_t first, size_t count)
+					{
+						if (runCount && runStart + runCount == first)
+							runCount += count;
+						else
+						{
+							flush();
+							runStart = first;
+							runCount = count;
+						}
+						trianglesDrawn += count / 3;
+					};
+
+					// the crease splits keep the triangle order, so the meshlets fit them too
+					if (fullDetail && cullMeshlets && submesh.meshletCount)
+					{
+						const Util::Meshlet* meshlets = model->Meshlets() + submesh.firstMeshlet;
+						for (uint32_t m = 0; m < submesh.meshletCount; m++)
+						{
+							const Util::Meshlet& meshlet = meshlets[m];
+							meshletsTested++;
+							if (!Util::SphereInFrustum(modelViewProjectionMat, meshlet.center, meshlet.radius)
+								|| (cullBackfacing && Util::ConeBackfacing(meshlet.coneApex, meshlet.coneAxis, meshlet.coneCutoff, modelCamera)))
+								continue;
+							append(meshlet.firstIndex, meshlet.indexCount);
+							meshletsDrawn++;
+						}
+					}
+					else
+						append(first, count);
+					submeshesDrawn++;
+				}
+				flush();
+			}
+		}
+		uniformRing.EndFrame();
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 		ImGui::Begin("Controls");
+		std::string current = loader.IsLoading() ? loader.Loading() : loader.Loaded();
+		if (ImGui::BeginCombo("Model", current.c_str()))
+		{
+			for (const std::string& path : models)
+			{
+				if (ImGui::Selectable(path.c_str(), path == current))
+					loader.Request(path);
+			}
+			ImGui::EndCombo();
+		}
+		if (loader.IsLoading())
+			ImGui::Text("Loading %s...", loader.Loading().c_str());
+		if (model)
+		{
+			ImGui::Text("Submeshes drawn: %zu / %zu", submeshesDrawn, model->SubmeshCount());
+			ImGui::Text("Draw calls: %zu (%zu materials)", drawCalls, model->MaterialCount());
+			ImGui::Text("Triangles drawn: %zu / %zu (%u lods)", trianglesDrawn, model->IndexCount() / 3, model->LodCount());
+			ImGui::SliderFloat("LOD error", &lodThreshold, 0, 16, "%.1f px");
+			ImGui::Checkbox("Cull meshlets", &cullMeshlets);
+			if (cullMeshlets)
+			{
+				ImGui::Checkbox("Cull back facing meshlets", &cullBackfacing);
+				ImGui::Text("Meshlets drawn: %zu / %zu (%zu in total)", meshletsDrawn, meshletsTested, model->MeshletCount());
+			}
+			ImGui::Text("Last upload: %.1f KB", lastReloadBytes / 1024.0);
+			if (const Util::MeshCacheStats* stats = model->Stats())
+			{
+				ImGui::Text("ACMR: %.3f (%.3f in file order)", stats->vertexCacheAfter.acmr, stats->vertexCacheBefore.acmr);
+				ImGui::Text("ATVR: %.3f (%.3f in file order)", stats->vertexCacheAfter.atvr, stats->vertexCacheBefore.atvr);
+				ImGui::Text("Welded vertices: %u", stats->weldedVertices);
+			}
+			ImGui::SliderInt("Crease angle", &creaseAngle, 0, 180, creaseAngle < 180 ? "%d deg" : "smooth");
+			ImGui::Text("Vertices: %zu", drawn->vertexCount);
+
+			// switching the layout re-uploads everything in the new one
+			const std::vector<Util::VertexLayoutInfo>& layouts = Util::GetVertexLayouts();
+			bool changed = false;
+			if (ImGui::BeginCombo("Vertex layout", layouts[layout].name.c_str()))
+			{
+				for (uint32_t i = 0; i < layouts.size(); i++)
+				{
+					if (ImGui::Selectable(layouts[i].name.c_str(), i == layout, programs[i].Id() ? 0 : ImGuiSelectableFlags_Disabled))
+					{
+						changed |= i != layout;
+						layout = i;
+					}
+				}
+				ImGui::EndCombo();
+			}
+			size_t gpuBytes = drawn->vertexBytes + drawn->indexCount * drawn->indexSize;
+			size_t floatBytes = drawn->vertexCount * 6 * sizeof(float) + drawn->indexCount * sizeof(uint32_t);
+			ImGui::Text("Layout: %s, %u B/vertex, %u-bit indices", layouts[drawn->layout].name.c_str(),
+				layouts[drawn->layout].stride, drawn->indexSize * 8);
+			ImGui::Text("GPU memory: %.1f KB (%.1f KB as floats)", gpuBytes / 1024.0, floatBytes / 1024.0);
+
+			if (changed)
+			{
+				GpuMesh uploaded = UploadMesh(*model, layout);
+				DeleteMesh(mesh);
+				mesh = uploaded;
+				for (auto& entry : creaseMeshes)
+					DeleteMesh(entry.second);
+				creaseMeshes.clear();
+			}
+		}
+
 		ImGui::SliderFloat("Object Position - X", &objectPosition.x, -10, 10);
 		ImGui::SliderFloat("Object Position - Y", &objectPosition.y, -10, 10);
 		ImGui::SliderFloat("Object Position - Z", &objectPosition.z, -10, 10);
@@ -219,17 +547,70 @@ int main()
 		ImGui::SliderFloat("Light Position - Y", &lightPosition.y, -10, 10);
 		ImGui::SliderFloat("Light Position - Z", &lightPosition.z, -10, 10);
 
-		ImGui::SliderFloat("ambinet", &ambient, 0, 1);
-		ImGui::SliderFloat("specular", &specular, 0, 1);
+		if (!materials.empty())
+		{
+			if (ImGui::BeginCombo("Material", model->MaterialName(selectedMaterial)))
+			{
+				for (size_t i = 0; i < materials.size(); i++)
+				{
+					if (ImGui::Selectable(model->MaterialName(i), (int)i == selectedMaterial))
+						selectedMaterial = i;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::SliderFloat("ambinet", &materials[selectedMaterial].ambient, 0, 1);
+			ImGui::SliderFloat("specular", &materials[selectedMaterial].specular, 0, 1);
+			ImGui::SliderFloat("roughness", &materials[selectedMaterial].roughness, 0, 1);
+		}
 		ImGui::End();
 
 		ImGui::Begin("Viewport");
 		ImGui::Image(ImTextureID(vpT), ImVec2(gs_iScreenWidth/1.3, gs_iScreenHeight/1.3), ImVec2(0, 1), ImVec2(1, 0));
+
+		// what's under the cursor. the image shows the whole framebuffer, so the cursor maps
+		// straight to ndc and back through the matrices it was drawn with into model space
+		if (model && ImGui::IsItemHovered())
+		{
+			ImVec2 imageMin = ImGui::GetItemRectMin();
+			ImVec2 imageSize = ImGui::GetItemRectSize();
+			ImVec2 mouse = ImGui::GetMousePos();
+			float x = (mouse.x - imageMin.x) / imageSize.x * 2 - 1;
+			float y = 1 - (mouse.y - imageMin.y) / imageSize.y * 2;
+			glm::mat4 inverseMvp = glm::inverse(modelViewProjectionMat);
+			glm::vec4 nearPoint = inverseMvp * glm::vec4(x, y, -1, 1);
+			glm::vec4 farPoint = inverseMvp * glm::vec4(x, y, 1, 1);
+			glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+			glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+			auto start = std::chrono::steady_clock::now();
+			Util::BvhHit hit;
+			bool found = model->Intersect(glm::value_ptr(origin), glm::value_ptr(direction), hit);
+			double pickMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+			if (found)
+			{
+				size_t submesh = 0;
+				for (size_t i = 0; i < model->SubmeshCount(); i++)
+				{
+					const Util::MeshCacheSubmesh& range = model->Submeshes()[i];
+					if (hit.triangle * 3 >= range.firstIndex && hit.triangle * 3 < range.firstIndex + range.indexCount)
+						submesh = i;
+				}
+				glm::vec3 position = glm::vec3(modelMat * glm::vec4(origin + direction * hit.t, 1));
+				ImGui::Text("Object: %s", model->SubmeshCount() ? model->SubmeshName(submesh) : "");
+				ImGui::Text("Triangle: %u", hit.triangle);
+				ImGui::Text("Position: %.3f %.3f %.3f", position.x, position.y, position.z);
+			}
+			else
+				ImGui::Text("Nothing under the cursor");
+			ImGui::Text("Pick: %.1f us (%zu bvh nodes)", pickMicros, model->BvhNodeCount());
+		}
 		ImGui::End();
 
 		ImGui::Begin("Colors");
 
-		ImGui::ColorPicker4("Object Color", glm::value_ptr(objectColor));
+		if (!materials.empty())
+			ImGui::ColorPicker4("Object Color", materials[selectedMaterial].color);
 		ImGui::ColorPicker4("Light Color", glm::value_ptr(lightColor));
 		ImGui::End();
 		ImGui::Render();
@@ -237,6 +618,12 @@ int main()
 		glfwSwapBuffers(window);
 	}
 
+	DeleteMesh(mesh);
+	for (auto& entry : creaseMeshes)
+		DeleteMesh(entry.second);
+	programs.clear();
+	uniformRing.Destroy();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -245,42 +632,103 @@ int main()
 	glfwTerminate();
 }
 
-uint32_t CreateShader(char* vss, char *fss)
+// the model's indices followed by the indices of all of its lods, they share one buffer
+std::vector<uint32_t> GpuIndices(const Util::MeshCache& model)
+{
+	std::vector<uint32_t> indices(model.Indices(), model.Indices() + model.IndexCount());
+	indices.insert(indices.end(), model.LodIndices(), model.LodIndices() + model.LodIndexCount());
+	return indices;
+}
+
+GpuMesh UploadMesh(const Util::MeshCache& model, uint32_t layout)
+{
+	std::vector<uint32_t> indices = GpuIndices(model);
+	return UploadMesh(model.Vertices(), model.VertexBytes(), indices.data(), indices.size(), layout);
+}
+
+// pack interleaved pos+normal floats into layout and upload them
+GpuMesh UploadMesh(const float* vertices, size_t vertexBytes, const uint32_t* indices, size_t indexCount, uint32_t layout)
+{
+	Util::PackedMesh packed = Util::PackMesh(vertices, vertexBytes / (6 * sizeof(float)), 6, indices, indexCount, layout);
+
+	GpuMesh mesh;
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+
+	glGenBuffers(1, &mesh.vbo);
+	glGenBuffers(1, &mesh.ebo);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+	glBufferData(GL_ARRAY_BUFFER, packed.vertices.size(), packed.vertices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.indices.size(), packed.indices.data(), GL_STATIC_DRAW);
+	Util::GetVertexLayouts()[layout].setAttributes();
+
+	mesh.vertexBytes = packed.vertices.size();
+	mesh.vertexCount = packed.vertexCount;
+	mesh.indexCount = packed.indexCount;
+	mesh.indexSize = packed.indexSize;
+	mesh.layout = layout;
+	memcpy(mesh.positionScale, packed.positionScale, sizeof(mesh.positionScale));
+	memcpy(mesh.positionOffset, packed.positionOffset, sizeof(mesh.positionOffset));
+	return mesh;
+}
+
+// re-upload only the parts of the buffers that differ between two versions of a model,
+// compared in the layout the mesh was uploaded in.
+// fails when the sizes changed, the buffers have to be reallocated then
+bool UpdateMesh(GpuMesh& mesh, const Util::MeshCache& from, const Util::MeshCache& to, size_t& uploaded)
 {
-	uint32_t vs = glCreateShader(GL_VERTEX_SHADER);
-	uint32_t fs = glCreateShader(GL_FRAGMENT_SHADER);
-
-	glShaderSource(vs, 1, &vss, nullptr);
-	glShaderSource(fs, 1, &fss, nullptr);
-	glCompileShader(vs);
-	glCompileShader(fs);
-
-	int s;
-	char infoLog[512];
-	glGetShaderiv(vs, GL_COMPILE_STATUS, &s);
-	if (!s)
+	std::vector<uint32_t> fromIndices = GpuIndices(from);
+	std::vector<uint32_t> toIndices = GpuIndices(to);
+	if (!mesh.vao || from.VertexBytes() != to.VertexBytes() || fromIndices.size() != toIndices.size()
+		|| mesh.vertexCount != to.VertexCount() || mesh.indexCount != toIndices.size())
+		return false;
+
+	Util::PackedMesh before = Util::PackMesh(from.Vertices(), from.VertexCount(), 6, fromIndices.data(), fromIndices.size(), mesh.layout);
+	Util::PackedMesh after = Util::PackMesh(to.Vertices(), to.VertexCount(), 6, toIndices.data(), toIndices.size(), mesh.layout);
+
+	uploaded = 0;
+	glBindVertexArray(mesh.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	for (const auto& range : Util::DiffRanges(before.vertices.data(), after.vertices.data(), after.vertices.size()))
 	{
-		glGetShaderInfoLog(vs, 512, nullptr, infoLog);
-		std::cout << "Vertex shader failed to compile!\n" << infoLog << std::endl;
+		glBufferSubData(GL_ARRAY_BUFFER, range.first, range.second, after.vertices.data() + range.first);
+		uploaded += range.second;
 	}
-	glGetShaderiv(fs, GL_COMPILE_STATUS, &s);
-	if (!s)
+	for (const auto& range : Util::DiffRanges(before.indices.data(), after.indices.data(), after.indices.size()))
 	{
-		glGetShaderInfoLog(fs, 512, nullptr, infoLog);
-		std::cout << "Fragment shader failed to compile!\n" << infoLog << std::endl;
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.first, range.second, after.indices.data() + range.first);
+		uploaded += range.second;
 	}
+	// the bounds may have moved
+	memcpy(mesh.positionScale, after.positionScale, sizeof(mesh.positionScale));
+	memcpy(mesh.positionOffset, after.positionOffset, sizeof(mesh.positionOffset));
+	return true;
+}
 
+void DeleteMesh(GpuMesh& mesh)
+{
+	if (mesh.vao)
+	{
+		glDeleteVertexArrays(1, &mesh.vao);
+		glDeleteBuffers(1, &mesh.vbo);
+		glDeleteBuffers(1, &mesh.ebo);
+	}
+	mesh = GpuMesh();
+}
 
-	uint32_t program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-
-	glGetProgramiv(program, GL_LINK_STATUS, &s);
-	if (!s)
+// the mesh files in directory that there is an importer for, sorted by name
+std::vector<std::string> FindModels(const char* directory)
+{
+	std::vector<std::string> models;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
 	{
-		glGetProgramInfoLog(program, 512, nullptr, infoLog);
-		std::cout << "Failed to link program\n" << infoLog << std::endl;
+		if (Util::IsMeshFile(entry.path().c_str()))
+			models.push_back(entry.path().string());
 	}
-	return program;
+	std::sort(models.begin(), models.end());
+	return models;
 }
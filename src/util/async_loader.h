@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include "mesh_cache.h"
+
+namespace Util
+{
+
+	// loads models through their cache on a background thread. only one load runs at a
+	// time, requesting another model while one is in flight replaces the queued request,
+	// so quickly switching through models only ever loads the last one picked
+	class AsyncMeshLoader
+	{
+	public:
+		~AsyncMeshLoader()
+		{
+			if (m_pending.valid())
+				m_pending.wait();
+		}
+
+		void Request(const std::string& filename)
+		{
+			m_sQueued = filename;
+			m_bQueued = true;
+			StartQueued();
+		}
+
+		// call once per frame. returns the finished model, or nullptr while nothing is ready.
+		// a model that failed to load comes back closed
+		std::unique_ptr<MeshCache> Poll()
+		{
+			if (!m_pending.valid() || m_pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return nullptr;
+
+			std::unique_ptr<MeshCache> model = m_pending.get();
+			// a newer request came in while this one was loading, it wins
+			if (m_bQueued)
+			{
+				StartQueued();
+				return nullptr;
+			}
+			m_sLoaded = m_sLoading;
+			return model;
+		}
+
+		bool IsLoading() const { return m_pending.valid(); }
+		const std::string& Loading() const { return m_sLoading; }
+		const std::string& Loaded() const { return m_sLoaded; }
+
+	private:
+		void StartQueued()
+		{
+			if (m_pending.valid())
+				return;
+			m_sLoading = m_sQueued;
+			m_bQueued = false;
+			std::string filename = m_sLoading;
+			m_pending = std::async(std::launch::async, [filename]()
+			{
+				std::unique_ptr<MeshCache> model(new MeshCache());
+				LoadMeshCached(filename.c_str(), *model);
+				return model;
+			});
+		}
+
+		std::future<std::unique_ptr<MeshCache>> m_pending;
+		std::string m_sLoading;
+		std::string m_sLoaded;
+		std::string m_sQueued;
+		bool m_bQueued = false;
+	};
+}
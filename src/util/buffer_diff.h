@@ -0,0 +1,31 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace Util
+{
+
+	// the byte ranges (offset, size) in which two equally sized buffers differ, at a
+	// granularity of blockSize. neighbouring changed blocks are merged into one range,
+	// so the result maps to as few glBufferSubData calls as possible
+	std::vector<std::pair<size_t, size_t>> DiffRanges(const void* a, const void* b, size_t size, size_t blockSize = 4096)
+	{
+		std::vector<std::pair<size_t, size_t>> ranges;
+		const char* pa = (const char*)a;
+		const char* pb = (const char*)b;
+		for (size_t offset = 0; offset < size; offset += blockSize)
+		{
+			size_t length = std::min(blockSize, size - offset);
+			if (memcmp(pa + offset, pb + offset, length) == 0)
+				continue;
+			if (!ranges.empty() && ranges.back().first + ranges.back().second == offset)
+				ranges.back().second += length;
+			else
+				ranges.push_back({offset, length});
+		}
+		return ranges;
+	}
+}
@@ -0,0 +1,460 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	// bins per axis the split candidates are taken from
+	constexpr uint32_t BVH_BINS = 16;
+	// nodes with more triangles than this bin in parallel and build their children in parallel
+	constexpr uint32_t BVH_PARALLEL_SPLIT = 1 << 12;
+	constexpr uint32_t BVH_PARALLEL_BINNING = 1 << 16;
+	// what visiting an inner node costs compared to testing a triangle, it tests two boxes
+	constexpr float BVH_TRAVERSAL_COST = 2.0f;
+	// nodes a traversal keeps on the call stack, enough for any balanced tree
+	constexpr uint32_t BVH_STACK_SIZE = 64;
+
+	// 32 bytes, two to a cache line. the children of a node are next to each other
+	struct BvhNode
+	{
+		float boundsMin[3];
+		uint32_t leftFirst; // the left child when count is 0, else the first triangle of the leaf
+		float boundsMax[3];
+		uint32_t count;     // triangles in the leaf, 0 for an inner node
+
+		bool IsLeaf() const { return count != 0; }
+	};
+
+	// a bounding volume hierarchy over the triangles of an index buffer. the leaves point into
+	// triangles, which holds triangle numbers (index / 3) in leaf order. node 0 is the root and
+	// every node comes before its children
+	struct Bvh
+	{
+		std::vector<BvhNode> nodes;
+		std::vector<uint32_t> triangles;
+	};
+
+	struct BvhHit
+	{
+		uint32_t triangle = UINT32_MAX; // UINT32_MAX when nothing was hit
+		float t = INFINITY;             // along the ray direction
+		float u = 0, v = 0;             // barycentrics of the second and third corner
+	};
+
+	// the box around the 3 corners of a triangle, positions the first 3 floats of every stride
+	void TriangleBounds(const float* vertices, size_t stride, const uint32_t* triangle, float min[3], float max[3])
+	{
+		const float* p0 = vertices + triangle[0] * stride;
+		const float* p1 = vertices + triangle[1] * stride;
+		const float* p2 = vertices + triangle[2] * stride;
+		for (int c = 0; c < 3; c++)
+		{
+			min[c] = std::min({p0[c], p1[c], p2[c]});
+			max[c] = std::max({p0[c], p1[c], p2[c]});
+		}
+	}
+
+	// builds with binned sah (Wald, "On fast construction of SAH-based bounding volume
+	// hierarchies"). big nodes are binned and split in parallel
+	class BvhBuilder
+	{
+	public:
+		// positions are the first 3 floats of every stride floats
+		Bvh Build(const float* vertices, size_t stride, const uint32_t* indices, size_t numIndices)
+		{
+			Bvh bvh;
+			size_t numTriangles = numIndices / 3;
+			if (numTriangles == 0)
+				return bvh;
+
+			m_triangleBounds.resize(numTriangles * 6);
+			m_centroids.resize(numTriangles * 3);
+			ParallelBlocks(numTriangles, BVH_PARALLEL_BINNING, [&](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					float* bounds = &m_triangleBounds[t * 6];
+					TriangleBounds(vertices, stride, indices + t * 3, bounds, bounds + 3);
+					for (int c = 0; c < 3; c++)
+						m_centroids[t * 3 + c] = (bounds[c] + bounds[3 + c]) * 0.5f;
+				}
+			});
+
+			bvh.triangles.resize(numTriangles);
+			for (uint32_t t = 0; t < numTriangles; t++)
+				bvh.triangles[t] = t;
+			// a binary tree with at most one triangle per leaf
+			bvh.nodes.resize(numTriangles * 2 - 1);
+			m_pBvh = &bvh;
+			m_nodeCount = 1;
+
+			BvhNode& root = bvh.nodes[0];
+			root.leftFirst = 0;
+			root.count = numTriangles;
+			Subdivide(0);
+
+			bvh.nodes.resize(m_nodeCount.load());
+			bvh.nodes.shrink_to_fit();
+			m_pBvh = nullptr;
+			m_triangleBounds.clear();
+			m_centroids.clear();
+			return bvh;
+		}
+
+	private:
+		struct Bin
+		{
+			float boundsMin[3] = {INFINITY, INFINITY, INFINITY};
+			float boundsMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+			uint32_t count = 0;
+
+			void Grow(const float* min, const float* max)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					boundsMin[c] = std::min(boundsMin[c], min[c]);
+					boundsMax[c] = std::max(boundsMax[c], max[c]);
+				}
+			}
+
+			float Area() const
+			{
+				float d[3] = {boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]};
+				return d[0] < 0 ? 0 : d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+			}
+		};
+
+		// the bounds of the triangles and of their centroids, and the bins along each axis
+		struct Binning
+		{
+			Bin bounds;
+			Bin centroids;
+			Bin bins[3][BVH_BINS];
+		};
+
+		void Subdivide(uint32_t nodeIndex)
+		{
+			BvhNode& node = m_pBvh->nodes[nodeIndex];
+			uint32_t first = node.leftFirst;
+			uint32_t count = node.count;
+			uint32_t* triangles = &m_pBvh->triangles[first];
+
+			Binning binning;
+			if (count > BVH_PARALLEL_BINNING)
+			{
+				std::vector<Binning> blocks((count + BVH_PARALLEL_BINNING - 1) / BVH_PARALLEL_BINNING);
+				ParallelBlocks(count, BVH_PARALLEL_BINNING, [&](size_t begin, size_t end)
+				{
+					Bounds(triangles + begin, end - begin, blocks[begin / BVH_PARALLEL_BINNING]);
+				});
+				for (const Binning& block : blocks)
+				{
+					binning.bounds.Grow(block.bounds.boundsMin, block.bounds.boundsMax);
+					binning.centroids.Grow(block.centroids.boundsMin, block.centroids.boundsMax);
+				}
+				// the bins have to cover the same range in every block
+				ParallelBlocks(count, BVH_PARALLEL_BINNING, [&](size_t begin, size_t end)
+				{
+					Binning& block = blocks[begin / BVH_PARALLEL_BINNING];
+					block.centroids = binning.centroids;
+					Fill(triangles + begin, end - begin, block);
+				});
+				for (const Binning& block : blocks)
+				{
+					for (int axis = 0; axis < 3; axis++)
+					{
+						for (uint32_t b = 0; b < BVH_BINS; b++)
+						{
+							binning.bins[axis][b].Grow(block.bins[axis][b].boundsMin, block.bins[axis][b].boundsMax);
+							binning.bins[axis][b].count += block.bins[axis][b].count;
+						}
+					}
+				}
+			}
+			else
+			{
+				Bounds(triangles, count, binning);
+				Fill(triangles, count, binning);
+			}
+			std::copy(binning.bounds.boundsMin, binning.bounds.boundsMin + 3, node.boundsMin);
+			std::copy(binning.bounds.boundsMax, binning.bounds.boundsMax + 3, node.boundsMax);
+			if (count <= 1)
+				return;
+
+			// sweep the bins from both sides for the cheapest split
+			float bestCost = INFINITY;
+			int bestAxis = -1;
+			uint32_t bestSplit = 0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (binning.centroids.boundsMax[axis] <= binning.centroids.boundsMin[axis])
+					continue;
+				const Bin* bins = binning.bins[axis];
+				float rightArea[BVH_BINS];
+				uint32_t rightCount[BVH_BINS];
+				Bin right;
+				uint32_t rightSum = 0;
+				for (uint32_t b = BVH_BINS - 1; b > 0; b--)
+				{
+					right.Grow(bins[b].boundsMin, bins[b].boundsMax);
+					rightSum += bins[b].count;
+					rightArea[b] = right.Area();
+					rightCount[b] = rightSum;
+				}
+				Bin left;
+				uint32_t leftSum = 0;
+				for (uint32_t b = 0; b + 1 < BVH_BINS; b++)
+				{
+					left.Grow(bins[b].boundsMin, bins[b].boundsMax);
+					leftSum += bins[b].count;
+					if (leftSum == 0 || rightCount[b + 1] == 0)
+						continue;
+					float cost = left.Area() * leftSum + rightArea[b + 1] * rightCount[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b + 1;
+					}
+				}
+			}
+
+			// a leaf when no split is cheaper than testing every triangle
+			float area = binning.bounds.Area();
+			if (bestAxis < 0 || (area > 0 && BVH_TRAVERSAL_COST + bestCost / area >= count))
+				return;
+
+			float min = binning.centroids.boundsMin[bestAxis];
+			float scale = BVH_BINS / (binning.centroids.boundsMax[bestAxis] - min);
+			uint32_t* middle = std::partition(triangles, triangles + count, [&](uint32_t t)
+			{
+				return BinIndex(m_centroids[t * 3 + bestAxis], min, scale) < bestSplit;
+			});
+			uint32_t leftCount = middle - triangles;
+			if (leftCount == 0 || leftCount == count)
+				return;
+
+			uint32_t left = m_nodeCount.fetch_add(2);
+			m_pBvh->nodes[left].leftFirst = first;
+			m_pBvh->nodes[left].count = leftCount;
+			m_pBvh->nodes[left + 1].leftFirst = first + leftCount;
+			m_pBvh->nodes[left + 1].count = count - leftCount;
+			node.leftFirst = left;
+			node.count = 0;
+
+			if (count > BVH_PARALLEL_SPLIT)
+				GetThreadPool().ParallelFor(2, [&](size_t i) { Subdivide(left + i); });
+			else
+			{
+				Subdivide(left);
+				Subdivide(left + 1);
+			}
+		}
+
+		// grow the triangle and centroid bounds of a binning by triangles
+		void Bounds(const uint32_t* triangles, size_t count, Binning& binning) const
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				const float* bounds = &m_triangleBounds[triangles[i] * 6];
+				const float* centroid = &m_centroids[triangles[i] * 3];
+				binning.bounds.Grow(bounds, bounds + 3);
+				binning.centroids.Grow(centroid, centroid);
+			}
+		}
+
+		// sort triangles into the bins of binning by their centroids
+		void Fill(const uint32_t* triangles, size_t count, Binning& binning) const
+		{
+			float scale[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float extent = binning.centroids.boundsMax[axis] - binning.centroids.boundsMin[axis];
+				scale[axis] = extent > 0 ? BVH_BINS / extent : 0;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				const float* bounds = &m_triangleBounds[triangles[i] * 6];
+				const float* centroid = &m_centroids[triangles[i] * 3];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					Bin& bin = binning.bins[axis][BinIndex(centroid[axis], binning.centroids.boundsMin[axis], scale[axis])];
+					bin.Grow(bounds, bounds + 3);
+					bin.count++;
+				}
+			}
+		}
+
+		static uint32_t BinIndex(float centroid, float min, float scale)
+		{
+			return std::min((uint32_t)((centroid - min) * scale), BVH_BINS - 1);
+		}
+
+		Bvh* m_pBvh = nullptr;
+		std::atomic<uint32_t> m_nodeCount{0};
+		std::vector<float> m_triangleBounds; // min and max per triangle
+		std::vector<float> m_centroids;
+	};
+
+	Bvh BuildBvh(const float* vertices, size_t stride, const uint32_t* indices, size_t numIndices)
+	{
+		return BvhBuilder().Build(vertices, stride, indices, numIndices);
+	}
+
+	// recompute the boxes after the vertices moved, the tree itself stays. it gets worse the
+	// further the triangles move from where they were built, rebuild after big changes
+	void RefitBvh(Bvh& bvh, const float* vertices, size_t stride, const uint32_t* indices)
+	{
+		ParallelBlocks(bvh.nodes.size(), BVH_PARALLEL_BINNING, [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; n++)
+			{
+				BvhNode& node = bvh.nodes[n];
+				if (!node.IsLeaf())
+					continue;
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					float min[3];
+					float max[3];
+					TriangleBounds(vertices, stride, indices + bvh.triangles[node.leftFirst + i] * 3, min, max);
+					for (int c = 0; c < 3; c++)
+					{
+						node.boundsMin[c] = i == 0 ? min[c] : std::min(node.boundsMin[c], min[c]);
+						node.boundsMax[c] = i == 0 ? max[c] : std::max(node.boundsMax[c], max[c]);
+					}
+				}
+			}
+		});
+		// children always come after their parent
+		for (size_t n = bvh.nodes.size(); n-- > 0;)
+		{
+			BvhNode& node = bvh.nodes[n];
+			if (node.IsLeaf())
+				continue;
+			const BvhNode& left = bvh.nodes[node.leftFirst];
+			const BvhNode& right = bvh.nodes[node.leftFirst + 1];
+			for (int c = 0; c < 3; c++)
+			{
+				node.boundsMin[c] = std::min(left.boundsMin[c], right.boundsMin[c]);
+				node.boundsMax[c] = std::max(left.boundsMax[c], right.boundsMax[c]);
+			}
+		}
+	}
+
+	// distance along the ray to where it enters the box, INFINITY when it misses or the box
+	// is further than maxT
+	float IntersectBox(const float* origin, const float* invDirection, const float* min, const float* max, float maxT)
+	{
+		float tMin = 0;
+		float tMax = maxT;
+		for (int c = 0; c < 3; c++)
+		{
+			float t0 = (min[c] - origin[c]) * invDirection[c];
+			float t1 = (max[c] - origin[c]) * invDirection[c];
+			tMin = std::max(tMin, std::min(t0, t1));
+			tMax = std::min(tMax, std::max(t0, t1));
+		}
+		return tMin <= tMax ? tMin : INFINITY;
+	}
+
+	// möller-trumbore, both sides of the triangle count
+	bool IntersectTriangle(const float* origin, const float* direction, const float* p0, const float* p1, const float* p2, float& t, float& u, float& v)
+	{
+		float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+		float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+		float p[3] = {direction[1] * e2[2] - direction[2] * e2[1], direction[2] * e2[0] - direction[0] * e2[2], direction[0] * e2[1] - direction[1] * e2[0]};
+		float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+		if (std::fabs(det) < 1e-12f)
+			return false;
+		float invDet = 1 / det;
+		float s[3] = {origin[0] - p0[0], origin[1] - p0[1], origin[2] - p0[2]};
+		u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+		if (u < 0 || u > 1)
+			return false;
+		float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+		v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invDet;
+		if (v < 0 || u + v > 1)
+			return false;
+		t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+		return t >= 0;
+	}
+
+	// the closest triangle along a ray. the arrays are the ones of a Bvh, or straight from a
+	// mesh cache. nearer children are visited first so most far ones are never opened
+	bool IntersectBvh(const BvhNode* nodes, size_t numNodes, const uint32_t* triangles, const float* vertices, size_t stride, const uint32_t* indices,
+		const float origin[3], const float direction[3], BvhHit& hit)
+	{
+		hit = BvhHit();
+		if (numNodes == 0)
+			return false;
+
+		float invDirection[3];
+		for (int c = 0; c < 3; c++)
+			invDirection[c] = 1 / direction[c];
+
+		// a degenerate tree can be deeper than the stack, what doesn't fit goes on the heap. nodes
+		// only go to the spill once the stack is full, so popping it first keeps the order
+		uint32_t stack[BVH_STACK_SIZE];
+		uint32_t depth = 0;
+		std::vector<uint32_t> spill;
+		auto push = [&](uint32_t n)
+		{
+			if (depth < BVH_STACK_SIZE)
+				stack[depth++] = n;
+			else
+				spill.push_back(n);
+		};
+		if (IntersectBox(origin, invDirection, nodes[0].boundsMin, nodes[0].boundsMax, INFINITY) == INFINITY)
+			return false;
+		push(0);
+		while (depth)
+		{
+			uint32_t n;
+			if (!spill.empty())
+			{
+				n = spill.back();
+				spill.pop_back();
+			}
+			else
+				n = stack[--depth];
+			const BvhNode& node = nodes[n];
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					uint32_t triangle = triangles[node.leftFirst + i];
+					const uint32_t* corners = indices + triangle * 3;
+					float t, u, v;
+					if (IntersectTriangle(origin, direction, vertices + corners[0] * stride, vertices + corners[1] * stride, vertices + corners[2] * stride, t, u, v) && t < hit.t)
+					{
+						hit.triangle = triangle;
+						hit.t = t;
+						hit.u = u;
+						hit.v = v;
+					}
+				}
+				continue;
+			}
+
+			uint32_t near = node.leftFirst;
+			uint32_t far = node.leftFirst + 1;
+			float tNear = IntersectBox(origin, invDirection, nodes[near].boundsMin, nodes[near].boundsMax, hit.t);
+			float tFar = IntersectBox(origin, invDirection, nodes[far].boundsMin, nodes[far].boundsMax, hit.t);
+			if (tFar < tNear)
+			{
+				std::swap(near, far);
+				std::swap(tNear, tFar);
+			}
+			if (tFar != INFINITY)
+				push(far);
+			if (tNear != INFINITY)
+				push(near);
+		}
+		return hit.triangle != UINT32_MAX;
+	}
+}
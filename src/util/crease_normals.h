@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "normals.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	// a mesh with its vertices split along hard edges, interleaved pos+normal
+	struct CreaseMesh
+	{
+		std::vector<float> vertices;
+		std::vector<uint32_t> indices;
+
+		size_t VertexCount() const { return vertices.size() / 6; }
+	};
+
+	// angle weighted normals that are only smoothed across edges flatter than a crease angle.
+	// Build does the work that doesn't depend on the angle once, Compute then only has to
+	// group the corners around each vertex, so trying another angle is cheap
+	class CreaseNormals
+	{
+	public:
+		// positions are the first 3 floats of every vertex, stride in floats
+		void Build(const float* vertices, size_t numVertices, size_t stride, const uint32_t* indices, size_t numIndices)
+		{
+			m_positions.resize(numVertices * 3);
+			for (size_t i = 0; i < numVertices; i++)
+				std::copy(vertices + i * stride, vertices + i * stride + 3, &m_positions[i * 3]);
+			m_indices.assign(indices, indices + numIndices / 3 * 3);
+			m_adjacency = BuildVertexAdjacency(numVertices, m_indices);
+
+			size_t numTriangles = m_indices.size() / 3;
+			m_faceNormals.resize(numTriangles * 3);
+			m_cornerAngles.resize(numTriangles * 3);
+			ParallelBlocks(numTriangles, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				ComputeFaceNormals(m_positions.data(), numVertices, m_indices.data(), begin, end, m_faceNormals.data());
+				for (size_t t = begin; t < end; t++)
+				{
+					float* n = &m_faceNormals[t * 3];
+					if (n[0] == 0 && n[1] == 0 && n[2] == 0)
+					{
+						// degenerate, or an index out of range: no weight anywhere
+						m_cornerAngles[t * 3] = m_cornerAngles[t * 3 + 1] = m_cornerAngles[t * 3 + 2] = 0;
+						continue;
+					}
+					NormalizeNormal(n);
+					for (int k = 0; k < 3; k++)
+						m_cornerAngles[t * 3 + k] = CornerAngle(t, k);
+				}
+			});
+			m_bBuilt = true;
+		}
+
+		bool IsBuilt() const { return m_bBuilt; }
+
+		void Clear()
+		{
+			*this = CreaseNormals();
+		}
+
+		// split every vertex into one copy per fan of faces around it that meet at less than
+		// angle degrees. 180 smooths everything, 0 gives flat shading
+		CreaseMesh Compute(float angle) const
+		{
+			CreaseMesh out;
+			size_t numVertices = m_positions.size() / 3;
+			float cosAngle = std::cos(std::min(std::max(angle, 0.0f), 180.0f) * (float)M_PI / 180.0f);
+
+			// the normal of every corner around every vertex, in adjacency order, and the
+			// copy of the vertex it ends up in
+			std::vector<float> cornerNormals(m_adjacency.triangles.size() * 3);
+			std::vector<uint32_t> cornerGroups(m_adjacency.triangles.size());
+			std::vector<uint32_t> firstSplit(numVertices + 1, 0);
+			ParallelBlocks(numVertices, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				GroupScratch scratch;
+				for (size_t v = begin; v < end; v++)
+					firstSplit[v + 1] = GroupCorners(v, cosAngle, cornerNormals.data(), cornerGroups.data(), scratch);
+			});
+			for (size_t v = 0; v < numVertices; v++)
+				firstSplit[v + 1] += firstSplit[v];
+
+			out.vertices.resize(firstSplit[numVertices] * 6);
+			out.indices.assign(m_indices.size(), 0);
+			ParallelBlocks(numVertices, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+				{
+					const float* p = &m_positions[v * 3];
+					if (m_adjacency.Begin(v) == m_adjacency.End(v))
+					{
+						// keep unused vertices so they still line up with the source
+						float* dst = &out.vertices[firstSplit[v] * 6];
+						std::copy(p, p + 3, dst);
+						dst[3] = 0;
+						dst[4] = 0;
+						dst[5] = 1;
+						continue;
+					}
+					for (uint32_t i = m_adjacency.offsets[v]; i < m_adjacency.offsets[v + 1]; i++)
+					{
+						uint32_t t = m_adjacency.triangles[i];
+						uint32_t split = firstSplit[v] + cornerGroups[i];
+						float* dst = &out.vertices[split * 6];
+						std::copy(p, p + 3, dst);
+						std::copy(&cornerNormals[i * 3], &cornerNormals[i * 3] + 3, dst + 3);
+						// only this vertex writes the corners that point at it
+						for (int k = 0; k < 3; k++)
+						{
+							if (m_indices[t * 3 + k] == v)
+								out.indices[t * 3 + k] = split;
+						}
+					}
+				}
+			});
+			return out;
+		}
+
+	private:
+		// the angle of triangle t at corner k, between its two edges there
+		float CornerAngle(size_t t, int k) const
+		{
+			const float* p0 = &m_positions[m_indices[t * 3 + k] * 3];
+			const float* p1 = &m_positions[m_indices[t * 3 + (k + 1) % 3] * 3];
+			const float* p2 = &m_positions[m_indices[t * 3 + (k + 2) % 3] * 3];
+			float a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float c[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+			float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+			return std::atan2(std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]), dot);
+		}
+
+		// the angle weight of vertex v in triangle t
+		float CornerWeight(uint32_t v, uint32_t t) const
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				if (m_indices[t * 3 + k] == v)
+					return m_cornerAngles[t * 3 + k];
+			}
+			return 0;
+		}
+
+		// per thread space for GroupCorners
+		struct GroupScratch
+		{
+			std::vector<std::pair<uint32_t, uint32_t>> edges;
+			std::vector<uint32_t> parents;
+			std::vector<uint32_t> groups;
+			std::vector<float> sums;
+		};
+
+		static uint32_t FindRoot(std::vector<uint32_t>& parents, uint32_t i)
+		{
+			while (parents[i] != i)
+				i = parents[i] = parents[parents[i]];
+			return i;
+		}
+
+		// the faces around v are joined across the edges they share when the angle between
+		// them is below the crease angle. each joined fan becomes one copy of v with the angle
+		// weighted normal of its faces. returns the number of copies v needs
+		uint32_t GroupCorners(uint32_t v, float cosAngle, float* cornerNormals, uint32_t* cornerGroups, GroupScratch& scratch) const
+		{
+			uint32_t first = m_adjacency.offsets[v];
+			uint32_t count = m_adjacency.offsets[v + 1] - first;
+			if (count == 0)
+				return 1;
+			const uint32_t* faces = m_adjacency.Begin(v);
+
+			// the other two corners of every face, faces with the same one share that edge
+			scratch.edges.clear();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t corner = m_indices[faces[i] * 3 + k];
+					if (corner != v)
+						scratch.edges.emplace_back(corner, i);
+				}
+			}
+			std::sort(scratch.edges.begin(), scratch.edges.end());
+
+			scratch.parents.resize(count);
+			for (uint32_t i = 0; i < count; i++)
+				scratch.parents[i] = i;
+			for (size_t e = 1; e < scratch.edges.size(); e++)
+			{
+				if (scratch.edges[e].first != scratch.edges[e - 1].first)
+					continue;
+				uint32_t a = scratch.edges[e - 1].second;
+				uint32_t b = scratch.edges[e].second;
+				const float* fa = &m_faceNormals[faces[a] * 3];
+				const float* fb = &m_faceNormals[faces[b] * 3];
+				if (fa[0] * fb[0] + fa[1] * fb[1] + fa[2] * fb[2] >= cosAngle)
+				{
+					a = FindRoot(scratch.parents, a);
+					b = FindRoot(scratch.parents, b);
+					scratch.parents[std::max(a, b)] = std::min(a, b);
+				}
+			}
+
+			// number the fans in the order they first show up and sum them in face order
+			scratch.groups.assign(count, UINT32_MAX);
+			scratch.sums.clear();
+			uint32_t numGroups = 0;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t root = FindRoot(scratch.parents, i);
+				if (scratch.groups[root] == UINT32_MAX)
+				{
+					scratch.groups[root] = numGroups++;
+					scratch.sums.insert(scratch.sums.end(), 3, 0.0f);
+				}
+				uint32_t group = scratch.groups[root];
+				cornerGroups[first + i] = group;
+
+				float weight = CornerWeight(v, faces[i]);
+				const float* f = &m_faceNormals[faces[i] * 3];
+				for (int c = 0; c < 3; c++)
+					scratch.sums[group * 3 + c] += f[c] * weight;
+			}
+			for (uint32_t g = 0; g < numGroups; g++)
+				NormalizeNormal(&scratch.sums[g * 3]);
+			for (uint32_t i = 0; i < count; i++)
+				std::copy(&scratch.sums[cornerGroups[first + i] * 3], &scratch.sums[cornerGroups[first + i] * 3] + 3, cornerNormals + (first + i) * 3);
+			return numGroups;
+		}
+
+		std::vector<float> m_positions;
+		std::vector<uint32_t> m_indices;
+		VertexAdjacency m_adjacency;
+		std::vector<float> m_faceNormals;
+		std::vector<float> m_cornerAngles;
+		bool m_bBuilt = false;
+	};
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace Util
+{
+
+	// whether an axis aligned box (in model space) can be visible through mvp.
+	// the frustum planes are taken straight from the rows of the matrix and the box corner
+	// furthest along each plane's normal is tested, so this is conservative near the corners
+	bool BoxInFrustum(const glm::mat4& mvp, const float min[3], const float max[3])
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec4 plane = (i & 1) ? rows[3] + rows[i / 2] * -1.0f : rows[3] + rows[i / 2];
+			float d = plane.w;
+			for (int axis = 0; axis < 3; axis++)
+				d += plane[axis] * (plane[axis] >= 0 ? max[axis] : min[axis]);
+			if (d < 0)
+				return false;
+		}
+		return true;
+	}
+
+	// whether a sphere (in model space) can be visible through mvp
+	bool SphereInFrustum(const glm::mat4& mvp, const float center[3], float radius)
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec4 plane = (i & 1) ? rows[3] + rows[i / 2] * -1.0f : rows[3] + rows[i / 2];
+			float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+			if (plane.x * center[0] + plane.y * center[1] + plane.z * center[2] + plane.w < -radius * length)
+				return false;
+		}
+		return true;
+	}
+
+	// whether every triangle of a meshlet faces away from camera (in model space), i.e. the
+	// camera is inside the cone that opens backwards from its apex
+	bool ConeBackfacing(const float apex[3], const float axis[3], float cutoff, const glm::vec3& camera)
+	{
+		glm::vec3 toApex(apex[0] - camera.x, apex[1] - camera.y, apex[2] - camera.z);
+		float length = glm::length(toApex);
+		return length > 0 && glm::dot(toApex, glm::vec3(axis[0], axis[1], axis[2])) >= cutoff * length;
+	}
+}
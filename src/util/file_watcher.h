@@ -0,0 +1,83 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+namespace Util
+{
+
+	// reports changes to a set of files through inotify. the directories are watched rather
+	// than the files themselves, most editors (and WriteFileAtomic) save by writing a new file
+	// and renaming it over the old one, which would silently end a watch on the file
+	class FileWatcher
+	{
+	public:
+		FileWatcher()
+		{
+			m_iFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		}
+
+		~FileWatcher()
+		{
+			if (m_iFd >= 0)
+				close(m_iFd);
+		}
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		void Watch(const std::string& path)
+		{
+			if (m_iFd < 0)
+				return;
+			size_t slash = path.find_last_of('/');
+			std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+			std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+			int wd = inotify_add_watch(m_iFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd < 0)
+				return;
+			m_files[wd].insert(name);
+		}
+
+		// stop watching everything
+		void Clear()
+		{
+			for (const auto& watch : m_files)
+				inotify_rm_watch(m_iFd, watch.first);
+			m_files.clear();
+		}
+
+		// whether any of the watched files changed since the last call, never blocks
+		bool Poll()
+		{
+			if (m_iFd < 0)
+				return false;
+
+			bool changed = false;
+			alignas(inotify_event) char buff[4096];
+			for (;;)
+			{
+				ssize_t numRead = read(m_iFd, buff, sizeof(buff));
+				if (numRead <= 0)
+					break;
+				for (char* p = buff; p < buff + numRead;)
+				{
+					const inotify_event* event = (const inotify_event*)p;
+					auto watch = m_files.find(event->wd);
+					if (event->len && watch != m_files.end() && watch->second.count(event->name))
+						changed = true;
+					p += sizeof(inotify_event) + event->len;
+				}
+			}
+			return changed;
+		}
+
+	private:
+		int m_iFd = -1;
+		// the names of the watched files in each watched directory
+		std::map<int, std::set<std::string>> m_files;
+	};
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	constexpr size_t HALF_EDGE_PARALLEL_BLOCK = 1 << 14;
+
+	// the topology of an indexed triangle list. half-edge h is corner h of the indices, it runs
+	// from indices[h] to the next corner of its triangle, so next, prev, face and the vertices
+	// are arithmetic and only the twins and one outgoing half-edge per vertex are stored.
+	// that's 4 bytes per half-edge and 5 per vertex. the indices have to outlive it
+	class HalfEdgeMesh
+	{
+	public:
+		static constexpr uint32_t NONE = UINT32_MAX;
+		// the twin of a half-edge whose edge has more than 2 triangles, or 2 facing the same way
+		static constexpr uint32_t NON_MANIFOLD = UINT32_MAX - 1;
+
+		// corners that reference a vertex out of range don't get a twin and are left out
+		// of the vertices' rings
+		void Build(const uint32_t* indices, size_t numIndices, size_t numVertices)
+		{
+			m_pIndices = indices;
+			size_t numHalfEdges = numIndices / 3 * 3;
+			m_twins.assign(numHalfEdges, NONE);
+			m_vertexEdges.assign(numVertices, NONE);
+			m_vertexFlags.assign(numVertices, 0);
+			auto valid = [&](uint32_t h) { return indices[h] < numVertices && indices[Next(h)] < numVertices; };
+
+			// a counting sort of the half-edges by their lower vertex, so both halves of an edge
+			// land in the same short list. the order within a list is fixed by sorting it after
+			std::vector<std::atomic<uint32_t>> counts(numVertices + 1);
+			std::vector<std::atomic<uint32_t>> valences(numVertices);
+			ParallelBlocks(numHalfEdges, HALF_EDGE_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t h = begin; h < end; h++)
+				{
+					if (!valid(h))
+						continue;
+					counts[std::min(From(h), To(h)) + 1].fetch_add(1, std::memory_order_relaxed);
+					valences[From(h)].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+			std::vector<uint32_t> offsets(numVertices + 1, 0);
+			for (size_t v = 0; v < numVertices; v++)
+				offsets[v + 1] = offsets[v] + counts[v + 1].load(std::memory_order_relaxed);
+			for (size_t v = 0; v < numVertices; v++)
+				counts[v].store(offsets[v], std::memory_order_relaxed);
+			std::vector<uint32_t> sorted(offsets[numVertices]);
+			ParallelBlocks(numHalfEdges, HALF_EDGE_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t h = begin; h < end; h++)
+				{
+					if (valid(h))
+						sorted[counts[std::min(From(h), To(h))].fetch_add(1, std::memory_order_relaxed)] = h;
+				}
+			});
+
+			// within a list the half-edges of one edge are next to each other once sorted by
+			// their upper vertex. exactly 2 going opposite ways are twins
+			ParallelBlocks(numVertices, HALF_EDGE_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+				{
+					uint32_t* list = &sorted[offsets[v]];
+					size_t count = offsets[v + 1] - offsets[v];
+					auto upper = [&](uint32_t h) { return std::max(From(h), To(h)); };
+					std::sort(list, list + count, [&](uint32_t a, uint32_t b) { return upper(a) != upper(b) ? upper(a) < upper(b) : a < b; });
+					for (size_t i = 0; i < count;)
+					{
+						size_t j = i + 1;
+						while (j < count && upper(list[j]) == upper(list[i]))
+							j++;
+						if (j - i == 2 && From(list[i]) != From(list[i + 1]))
+						{
+							m_twins[list[i]] = list[i + 1];
+							m_twins[list[i + 1]] = list[i];
+						}
+						else if (j - i > 1 || From(list[i]) == To(list[i]))
+						{
+							for (size_t k = i; k < j; k++)
+								m_twins[list[k]] = NON_MANIFOLD;
+						}
+						i = j;
+					}
+				}
+			});
+
+			// every vertex starts at its border half-edge if it has one, so walking the ring
+			// forwards from there covers it. the lowest such half-edge wins, whichever thread finds it
+			std::vector<std::atomic<uint64_t>> starts(numVertices);
+			for (std::atomic<uint64_t>& start : starts)
+				start.store(UINT64_MAX, std::memory_order_relaxed);
+			ParallelBlocks(numHalfEdges, HALF_EDGE_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t h = begin; h < end; h++)
+				{
+					if (!valid(h))
+						continue;
+					uint64_t key = (uint64_t)(m_twins[h] != NONE) << 32 | h;
+					std::atomic<uint64_t>& start = starts[From(h)];
+					uint64_t current = start.load(std::memory_order_relaxed);
+					while (key < current && !start.compare_exchange_weak(current, key, std::memory_order_relaxed))
+						;
+				}
+			});
+
+			// a vertex is manifold when its ring is one fan or one disk that reaches all of its
+			// half-edges without crossing a non manifold edge
+			std::atomic<size_t> numBoundary{0};
+			std::atomic<size_t> numNonManifold{0};
+			ParallelBlocks(numVertices, HALF_EDGE_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				size_t boundary = 0;
+				size_t nonManifold = 0;
+				for (size_t v = begin; v < end; v++)
+				{
+					uint64_t start = starts[v].load(std::memory_order_relaxed);
+					if (start == UINT64_MAX)
+						continue;
+					uint32_t first = start & 0xffffffff;
+					m_vertexEdges[v] = first;
+					uint32_t valence = valences[v].load(std::memory_order_relaxed);
+					uint32_t reached = 0;
+					bool manifold = m_twins[first] != NON_MANIFOLD;
+					for (uint32_t h = first; manifold && reached <= valence;)
+					{
+						reached++;
+						uint32_t twin = m_twins[Prev(h)];
+						manifold = twin != NON_MANIFOLD && m_twins[h] != NON_MANIFOLD;
+						if (twin == NONE || twin == NON_MANIFOLD || twin == first)
+							break;
+						h = twin;
+					}
+					uint8_t flags = 0;
+					if (m_twins[first] == NONE)
+					{
+						flags |= VERTEX_BOUNDARY;
+						boundary++;
+					}
+					if (!manifold || reached != valence)
+					{
+						flags |= VERTEX_NON_MANIFOLD;
+						nonManifold++;
+					}
+					m_vertexFlags[v] = flags;
+				}
+				numBoundary += boundary;
+				numNonManifold += nonManifold;
+			});
+			m_iBoundaryVertexCount = numBoundary;
+			m_iNonManifoldVertexCount = numNonManifold;
+		}
+
+		size_t HalfEdgeCount() const { return m_twins.size(); }
+		size_t VertexCount() const { return m_vertexEdges.size(); }
+
+		uint32_t Next(uint32_t h) const { return h % 3 == 2 ? h - 2 : h + 1; }
+		uint32_t Prev(uint32_t h) const { return h % 3 == 0 ? h + 2 : h - 1; }
+		uint32_t Face(uint32_t h) const { return h / 3; }
+		uint32_t From(uint32_t h) const { return m_pIndices[h]; }
+		uint32_t To(uint32_t h) const { return m_pIndices[Next(h)]; }
+		// NONE on a border, NON_MANIFOLD when the edge has no single twin
+		uint32_t Twin(uint32_t h) const { return m_twins[h]; }
+		bool IsBoundaryEdge(uint32_t h) const { return m_twins[h] == NONE; }
+
+		// a half-edge starting at v, its border half-edge if it has one. NONE when no triangle uses v
+		uint32_t VertexEdge(uint32_t v) const { return m_vertexEdges[v]; }
+		// whether a border half-edge leaves v, on a manifold vertex the same as being on a border
+		bool IsBoundaryVertex(uint32_t v) const { return m_vertexFlags[v] & VERTEX_BOUNDARY; }
+		bool IsManifoldVertex(uint32_t v) const { return !(m_vertexFlags[v] & VERTEX_NON_MANIFOLD); }
+		size_t BoundaryVertexCount() const { return m_iBoundaryVertexCount; }
+		size_t NonManifoldVertexCount() const { return m_iNonManifoldVertexCount; }
+		bool IsManifold() const { return m_iNonManifoldVertexCount == 0; }
+
+		// call fn(h) for the half-edges leaving v, in order around it. a non manifold vertex
+		// only gets the fan its VertexEdge is in
+		template<typename F>
+		void ForEachOutgoing(uint32_t v, F&& fn) const
+		{
+			uint32_t first = m_vertexEdges[v];
+			if (first == NONE)
+				return;
+			uint32_t h = first;
+			do
+			{
+				fn(h);
+				h = m_twins[Prev(h)];
+			} while (h != first && h != NONE && h != NON_MANIFOLD);
+		}
+
+		// call fn(u) for the vertices around v, once each on a manifold vertex
+		template<typename F>
+		void ForEachNeighbour(uint32_t v, F&& fn) const
+		{
+			uint32_t last = NONE;
+			ForEachOutgoing(v, [&](uint32_t h)
+			{
+				fn(To(h));
+				last = h;
+			});
+			// a fan ends in a half-edge coming in, its vertex isn't the end of any going out
+			if (last != NONE && m_twins[Prev(last)] >= NON_MANIFOLD)
+				fn(From(Prev(last)));
+		}
+
+	private:
+		static constexpr uint8_t VERTEX_BOUNDARY = 1;
+		static constexpr uint8_t VERTEX_NON_MANIFOLD = 2;
+
+		const uint32_t* m_pIndices = nullptr;
+		std::vector<uint32_t> m_twins;
+		std::vector<uint32_t> m_vertexEdges;
+		std::vector<uint8_t> m_vertexFlags;
+		size_t m_iBoundaryVertexCount = 0;
+		size_t m_iNonManifoldVertexCount = 0;
+	};
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include "mesh.h"
+#include "obj.h"
+#include "ply.h"
+#include "stl.h"
+
+namespace Util
+{
+
+	// a mesh file format. every importer produces a Mesh with at least one submesh and
+	// the default material, normals are left empty if the file has none
+	struct MeshImporter
+	{
+		const char* extension; // lower case, with the dot
+		// recognise the format from the start of the file (and its size), may be null
+		bool (*probe)(const char* head, size_t headSize, size_t fileSize);
+		Mesh (*load)(const char* filename);
+	};
+
+	bool ProbeStl(const char* head, size_t headSize, size_t fileSize)
+	{
+		if (headSize < STL_HEADER_SIZE)
+			return false;
+		uint32_t numTriangles;
+		memcpy(&numTriangles, head + 80, 4);
+		return STL_HEADER_SIZE + (uint64_t)numTriangles * STL_TRIANGLE_SIZE == fileSize;
+	}
+
+	bool ProbePly(const char* head, size_t headSize, size_t /*fileSize*/)
+	{
+		return IsPly(head, headSize);
+	}
+
+	std::vector<MeshImporter>& GetMeshImporters()
+	{
+		static std::vector<MeshImporter> importers = {
+			{".obj", nullptr, LoadObjMesh},
+			{".ply", ProbePly, LoadPly},
+			{".stl", ProbeStl, LoadStl},
+		};
+		return importers;
+	}
+
+	// add a format, or replace the importer of an extension that is already known
+	void RegisterMeshImporter(const MeshImporter& importer)
+	{
+		for (MeshImporter& existing : GetMeshImporters())
+		{
+			if (strcmp(existing.extension, importer.extension) == 0)
+			{
+				existing = importer;
+				return;
+			}
+		}
+		GetMeshImporters().push_back(importer);
+	}
+
+	// the lower case extension of filename including the dot, empty if it has none
+	std::string FileExtension(const char* filename)
+	{
+		const char* dot = strrchr(filename, '.');
+		const char* slash = strrchr(filename, '/');
+		if (!dot || (slash && dot < slash))
+			return "";
+		std::string extension = dot;
+		for (char& c : extension)
+			c = tolower(c);
+		return extension;
+	}
+
+	// pick the importer for a file, by its magic bytes first and its extension second
+	const MeshImporter* FindMeshImporter(const char* filename)
+	{
+		char head[512];
+		size_t headSize = 0;
+		size_t fileSize = 0;
+		int fd = open(filename, O_RDONLY);
+		if (fd >= 0)
+		{
+			ssize_t numRead = read(fd, head, sizeof(head));
+			headSize = numRead > 0 ? numRead : 0;
+			off_t size = lseek(fd, 0, SEEK_END);
+			fileSize = size > 0 ? size : 0;
+			close(fd);
+		}
+
+		for (const MeshImporter& importer : GetMeshImporters())
+		{
+			if (importer.probe && importer.probe(head, headSize, fileSize))
+				return &importer;
+		}
+
+		std::string extension = FileExtension(filename);
+		for (const MeshImporter& importer : GetMeshImporters())
+		{
+			if (extension == importer.extension)
+				return &importer;
+		}
+		return nullptr;
+	}
+
+	// whether some importer claims files with this name's extension
+	bool IsMeshFile(const char* filename)
+	{
+		std::string extension = FileExtension(filename);
+		for (const MeshImporter& importer : GetMeshImporters())
+		{
+			if (extension == importer.extension)
+				return true;
+		}
+		return false;
+	}
+
+	// load any supported mesh file, an empty mesh when it can't be read
+	Mesh ImportMesh(const char* filename)
+	{
+		const MeshImporter* importer = FindMeshImporter(filename);
+		if (!importer)
+			return Mesh();
+		return importer->load(filename);
+	}
+}
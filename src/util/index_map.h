@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Util
+{
+
+	// mix the bits of a 64 bit value (the murmur3 finalizer)
+	inline uint64_t HashMix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// an open addressing (linear probing) map from a key to a uint32_t index.
+	// keys and values live inline in one flat array, so a lookup is usually a single cache miss.
+	// there is no erase, the maps are only ever filled and thrown away
+	template<typename K, typename Hash>
+	class IndexMap
+	{
+	public:
+		static constexpr uint32_t EMPTY = UINT32_MAX;
+
+		explicit IndexMap(size_t expectedSize = 16)
+		{
+			size_t capacity = 16;
+			while (capacity < expectedSize * 2)
+				capacity *= 2;
+			m_slots.resize(capacity);
+		}
+
+		// insert key -> value unless key is already there.
+		// returns the value stored for key and whether it was inserted
+		std::pair<uint32_t, bool> Insert(const K& key, uint32_t value)
+		{
+			if ((m_iSize + 1) * 2 > m_slots.size())
+				Grow();
+
+			size_t mask = m_slots.size() - 1;
+			for (size_t i = Hash()(key) & mask;; i = (i + 1) & mask)
+			{
+				Slot& slot = m_slots[i];
+				if (slot.value == EMPTY)
+				{
+					slot.key = key;
+					slot.value = value;
+					m_iSize++;
+					return {value, true};
+				}
+				if (slot.key == key)
+					return {slot.value, false};
+			}
+		}
+
+		// the value stored for key or EMPTY
+		uint32_t Find(const K& key) const
+		{
+			size_t mask = m_slots.size() - 1;
+			for (size_t i = Hash()(key) & mask;; i = (i + 1) & mask)
+			{
+				const Slot& slot = m_slots[i];
+				if (slot.value == EMPTY)
+					return EMPTY;
+				if (slot.key == key)
+					return slot.value;
+			}
+		}
+
+		size_t Size() const { return m_iSize; }
+
+	private:
+		struct Slot
+		{
+			K key;
+			uint32_t value = EMPTY;
+		};
+
+		void Grow()
+		{
+			std::vector<Slot> old(m_slots.size() * 2);
+			old.swap(m_slots);
+			size_t mask = m_slots.size() - 1;
+			for (const Slot& slot : old)
+			{
+				if (slot.value == EMPTY)
+					continue;
+				size_t i = Hash()(slot.key) & mask;
+				while (m_slots[i].value != EMPTY)
+					i = (i + 1) & mask;
+				m_slots[i] = slot;
+			}
+		}
+
+		std::vector<Slot> m_slots;
+		size_t m_iSize = 0;
+	};
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Util
+{
+
+	// a read only view of a whole file backed by mmap, so the contents are
+	// paged in by the kernel instead of being copied into our own buffer
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const char* filename) { Open(filename); }
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept
+			: m_pData(other.m_pData), m_iSize(other.m_iSize)
+		{
+			other.m_pData = nullptr;
+			other.m_iSize = 0;
+		}
+
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Close();
+				m_pData = other.m_pData;
+				m_iSize = other.m_iSize;
+				other.m_pData = nullptr;
+				other.m_iSize = 0;
+			}
+			return *this;
+		}
+
+		// fails for anything that is not a non-empty regular file (pipes, ttys, ...)
+		// so the caller can fall back to streaming
+		bool Open(const char* filename)
+		{
+			Close();
+			int fd = open(filename, O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+			{
+				close(fd);
+				return false;
+			}
+
+			void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			// the mapping keeps its own reference to the file
+			close(fd);
+			if (data == MAP_FAILED)
+				return false;
+
+			// we only ever walk the file front to back
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+			m_pData = (const char*)data;
+			m_iSize = st.st_size;
+			return true;
+		}
+
+		void Close()
+		{
+			if (m_pData)
+				munmap((void*)m_pData, m_iSize);
+			m_pData = nullptr;
+			m_iSize = 0;
+		}
+
+		bool IsOpen() const { return m_pData != nullptr; }
+		const char* Data() const { return m_pData; }
+		const char* End() const { return m_pData + m_iSize; }
+		size_t Size() const { return m_iSize; }
+
+	private:
+		const char* m_pData = nullptr;
+		size_t m_iSize = 0;
+	};
+
+	// call onLine(begin, end) for every line in [begin, end), end excludes the '\n'.
+	// the last line does not need to be terminated
+	template<typename F>
+	void ForEachLine(const char* begin, const char* end, F&& onLine)
+	{
+		const char* lineStart = begin;
+		while (lineStart < end)
+		{
+			const char* lineEnd = (const char*)memchr(lineStart, '\n', end - lineStart);
+			if (!lineEnd)
+				lineEnd = end;
+			onLine(lineStart, lineEnd);
+			lineStart = lineEnd + 1;
+		}
+	}
+
+	// split [begin, end) into at most numChunks ranges that each end right after a '\n'
+	// (or at end), so every line lands in exactly one range
+	std::vector<std::pair<const char*, const char*>> SplitLines(const char* begin, const char* end, size_t numChunks)
+	{
+		std::vector<std::pair<const char*, const char*>> chunks;
+		if (numChunks == 0)
+			numChunks = 1;
+		size_t chunkSize = (end - begin) / numChunks + 1;
+
+		const char* chunkStart = begin;
+		while (chunkStart < end)
+		{
+			const char* chunkEnd = chunkStart + chunkSize;
+			if (chunkEnd >= end)
+				chunkEnd = end;
+			else
+			{
+				const char* newLine = (const char*)memchr(chunkEnd, '\n', end - chunkEnd);
+				chunkEnd = newLine ? newLine + 1 : end;
+			}
+			chunks.emplace_back(chunkStart, chunkEnd);
+			chunkStart = chunkEnd;
+		}
+		return chunks;
+	}
+
+	// read fp in fixed size chunks and call onLine(begin, end) for every complete line.
+	// only a partial line is carried over between chunks, so this works for pipes and
+	// stdin without ever holding the whole file in memory
+	template<typename F>
+	void StreamLines(FILE* fp, F&& onLine, size_t chunkSize = 1 << 16)
+	{
+		std::vector<char> buff(chunkSize);
+		size_t carried = 0;
+		for (;;)
+		{
+			// a single line longer than the buffer, make room for it
+			if (carried == buff.size())
+				buff.resize(buff.size() * 2);
+
+			size_t numRead = fread(buff.data() + carried, 1, buff.size() - carried, fp);
+			if (numRead == 0)
+				break;
+
+			const char* begin = buff.data();
+			const char* end = begin + carried + numRead;
+			const char* lastNewLine = end;
+			while (lastNewLine > begin && lastNewLine[-1] != '\n')
+				--lastNewLine;
+
+			if (lastNewLine == begin)
+			{
+				// no complete line yet
+				carried += numRead;
+				continue;
+			}
+
+			ForEachLine(begin, lastNewLine - 1, onLine);
+
+			carried = end - lastNewLine;
+			memmove(buff.data(), lastNewLine, carried);
+		}
+
+		if (carried)
+			onLine(buff.data(), buff.data() + carried);
+	}
+}
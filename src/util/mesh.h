@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Util
+{
+
+	// the shading parameters of a part of a mesh, the defaults are what the shader used
+	// before there were materials
+	struct Material
+	{
+		std::string name;
+		float color[4] = {1, 1, 1, 1};
+		float ambient = 0.3f;
+		float specular = 0.5f;
+		float roughness = 0;
+	};
+
+	// a range of the index buffer that came from one object/group/material of the source
+	struct Submesh
+	{
+		std::string name;     // "object", "group" or "object/group"
+		uint32_t material = 0; // index into Mesh::materials
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float boundsMin[3] = {0, 0, 0};
+		float boundsMax[3] = {0, 0, 0};
+	};
+
+	// an indexed triangle mesh. every attribute array is either empty or has one entry per vertex
+	struct Mesh
+	{
+		std::vector<float> positions; // x, y, z per vertex
+		std::vector<float> normals;   // x, y, z per vertex
+		std::vector<float> texCoords; // u, v per vertex
+		std::vector<uint32_t> indices; // 3 per triangle
+		std::vector<Submesh> submeshes; // cover indices in order, without gaps
+		std::vector<Material> materials; // the first one is the default material
+		std::vector<std::string> materialLibraries; // the mtl files the materials came from
+
+		size_t VertexCount() const { return positions.size() / 3; }
+		size_t TriangleCount() const { return indices.size() / 3; }
+	};
+
+	// axis aligned bounds of numVertices positions that are stride floats apart
+	void ComputeBounds(const float* positions, size_t numVertices, size_t stride, float min[3], float max[3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			min[i] = numVertices ? positions[i] : 0;
+			max[i] = numVertices ? positions[i] : 0;
+		}
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			const float* p = positions + v * stride;
+			for (int i = 0; i < 3; i++)
+			{
+				min[i] = p[i] < min[i] ? p[i] : min[i];
+				max[i] = p[i] > max[i] ? p[i] : max[i];
+			}
+		}
+	}
+
+	// bounds of the positions referenced by numIndices indices
+	void ComputeIndexedBounds(const float* positions, size_t stride, const uint32_t* indices, size_t numIndices, float min[3], float max[3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			min[i] = numIndices ? positions[indices[0] * stride + i] : 0;
+			max[i] = numIndices ? positions[indices[0] * stride + i] : 0;
+		}
+		for (size_t j = 0; j < numIndices; j++)
+		{
+			const float* p = positions + indices[j] * stride;
+			for (int i = 0; i < 3; i++)
+			{
+				min[i] = p[i] < min[i] ? p[i] : min[i];
+				max[i] = p[i] > max[i] ? p[i] : max[i];
+			}
+		}
+	}
+
+	// give a mesh that came without any structure the default material and one submesh
+	// covering all of it
+	void SetSingleSubmesh(Mesh& mesh)
+	{
+		Material material;
+		material.name = "default";
+		mesh.materials.assign(1, material);
+
+		Submesh submesh;
+		submesh.indexCount = mesh.indices.size();
+		ComputeIndexedBounds(mesh.positions.data(), 3, mesh.indices.data(), mesh.indices.size(), submesh.boundsMin, submesh.boundsMax);
+		mesh.submeshes.assign(1, submesh);
+	}
+}
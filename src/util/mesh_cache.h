@@ -0,0 +1,610 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "mapped_file.h"
+#include "index_map.h"
+#include "mesh.h"
+#include "normals.h"
+#include "importer.h"
+#include "vertex_cache.h"
+#include "simplify.h"
+#include "meshlets.h"
+#include "bvh.h"
+#include "weld.h"
+#include "spatial_order.h"
+
+namespace Util
+{
+
+	// a mesh cache file is the header, a table of sections and then the sections themselves,
+	// each aligned to 16 bytes. it is written next to the source as <source>.meshcache and
+	// mapped straight into memory on the next run, so nothing has to be parsed or generated.
+	// bump the version whenever the layout or the contents of a section change
+	constexpr uint32_t MESH_CACHE_VERSION = 10;
+	constexpr char MESH_CACHE_MAGIC[4] = {'P', 'M', 'S', 'H'};
+
+	enum class MeshCacheSection : uint32_t
+	{
+		Vertices = 1, // interleaved pos+normal, 6 floats per vertex
+		Indices = 2,  // uint32_t, 3 per triangle
+		Submeshes = 3, // MeshCacheSubmesh, sorted by material
+		Strings = 4,   // the names the submeshes and materials point into
+		Materials = 5, // MeshCacheMaterial
+		Dependencies = 6, // MeshCacheDependency, other files the cache was built from
+		Stats = 7,     // MeshCacheStats
+		Lods = 8,      // LodRange, one per submesh for every level after the first
+		LodIndices = 9, // uint32_t, the indices the lod ranges point into
+		Meshlets = 10, // Meshlet, in index order, the submeshes point into them
+		BvhNodes = 11, // BvhNode, over the triangles of Indices
+		BvhTriangles = 12, // uint32_t, the triangles of the bvh leaves
+	};
+
+	// what the cache was built from, it is stale as soon as this doesn't match the source anymore
+	struct MeshSourceInfo
+	{
+		uint64_t size = 0;
+		int64_t mtime = 0; // nanoseconds
+		uint64_t hash = 0; // of the whole file, only checked when the mtime differs
+	};
+
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		MeshSourceInfo source;
+		uint32_t vertexStride; // floats per vertex
+		uint32_t numSections;
+		float boundsMin[3];
+		float boundsMax[3];
+		float weldEpsilon; // the MeshCacheOptions it was built with
+		uint32_t spatialOrder;
+	};
+
+	struct MeshCacheSectionEntry
+	{
+		uint32_t type;
+		uint32_t reserved;
+		uint64_t offset; // from the start of the file
+		uint64_t size;   // in bytes
+	};
+
+	struct MeshCacheSubmesh
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t name; // offset into the string section, the strings are 0 terminated
+		uint32_t material; // index into the materials
+		uint32_t firstMeshlet; // the meshlets that cover the submesh's indices
+		uint32_t meshletCount;
+	};
+
+	struct MeshCacheMaterial
+	{
+		uint32_t name;
+		float color[4];
+		float ambient;
+		float specular;
+		float roughness;
+	};
+
+	// a file besides the source that went into the cache, e.g. an mtl.
+	// only its size and mtime are checked
+	struct MeshCacheDependency
+	{
+		MeshSourceInfo info;
+		uint32_t path; // offset into the string section
+		uint32_t reserved;
+	};
+
+	// how a cache is built, one built another way is stale
+	struct MeshCacheOptions
+	{
+		float weldEpsilon = WELD_EPSILON; // relative to the size of the mesh
+		// morton order the triangles before normals are generated. only normal generation sees
+		// that order, the optimization passes after it re-sort the triangles and renumber the
+		// vertices. it pays off for files stored in a scattered order, not for ordered ones
+		bool spatialOrder = false;
+	};
+
+	// what the optimization passes did to the mesh
+	struct MeshCacheStats
+	{
+		VertexCacheStats vertexCacheBefore;
+		VertexCacheStats vertexCacheAfter;
+		uint32_t weldedVertices; // merged into another vertex at load time
+	};
+
+	// a 64 bit hash of a block of memory, 8 bytes at a time
+	uint64_t HashBytes(const void* data, size_t size)
+	{
+		const char* p = (const char*)data;
+		uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, p + i, 8);
+			h = HashMix(h ^ word) + 0x9e3779b97f4a7c15ull;
+		}
+		uint64_t tail = 0;
+		memcpy(&tail, p + i, size - i);
+		return HashMix(h ^ tail);
+	}
+
+	// fill in the size and mtime of a file, the hash is left alone
+	bool StatMeshSource(const char* filename, MeshSourceInfo& info)
+	{
+		struct stat st;
+		if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+			return false;
+		info.size = st.st_size;
+		info.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+		return true;
+	}
+
+	uint64_t HashFile(const char* filename)
+	{
+		MappedFile file;
+		if (!file.Open(filename))
+			return 0;
+		return HashBytes(file.Data(), file.Size());
+	}
+
+	std::string MeshCachePath(const char* filename)
+	{
+		return std::string(filename) + ".meshcache";
+	}
+
+	// assembles the bytes of a cache file in memory.
+	// the section data isn't copied until Finish, it has to stay alive until then
+	class MeshCacheWriter
+	{
+	public:
+		void AddSection(MeshCacheSection type, const void* data, size_t size)
+		{
+			m_sections.push_back({(uint32_t)type, 0, 0, size});
+			m_data.push_back((const char*)data);
+		}
+
+		std::vector<char> Finish(MeshCacheHeader header)
+		{
+			memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+			header.version = MESH_CACHE_VERSION;
+			header.numSections = m_sections.size();
+
+			size_t offset = Align(sizeof(header) + m_sections.size() * sizeof(MeshCacheSectionEntry));
+			for (auto& section : m_sections)
+			{
+				section.offset = offset;
+				offset = Align(offset + section.size);
+			}
+
+			std::vector<char> out(offset, 0);
+			memcpy(out.data(), &header, sizeof(header));
+			memcpy(out.data() + sizeof(header), m_sections.data(), m_sections.size() * sizeof(MeshCacheSectionEntry));
+			for (size_t i = 0; i < m_sections.size(); i++)
+				memcpy(out.data() + m_sections[i].offset, m_data[i], m_sections[i].size);
+			return out;
+		}
+
+	private:
+		static size_t Align(size_t offset) { return (offset + 15) & ~(size_t)15; }
+
+		std::vector<MeshCacheSectionEntry> m_sections;
+		std::vector<const char*> m_data;
+	};
+
+	// a loaded cache, either mapped from disk or (when it couldn't be written) held in memory.
+	// the vertex and index pointers can be handed to glBufferData as they are
+	class MeshCache
+	{
+	public:
+		// map the cache at cachePath, fails if it is missing, broken, older than source or
+		// built with other options
+		bool Open(const char* cachePath, const char* sourcePath, const MeshSourceInfo& source, const MeshCacheOptions& options)
+		{
+			Close();
+			if (!m_file.Open(cachePath) || !Parse(m_file.Data(), m_file.Size()))
+			{
+				Close();
+				return false;
+			}
+
+			const MeshSourceInfo& cached = m_pHeader->source;
+			if (cached.size != source.size || m_pHeader->weldEpsilon != options.weldEpsilon || m_pHeader->spatialOrder != options.spatialOrder)
+			{
+				Close();
+				return false;
+			}
+			// touched but maybe not changed, e.g. by a checkout. hashing is still far cheaper than parsing
+			if (cached.mtime != source.mtime && cached.hash != HashFile(sourcePath))
+			{
+				Close();
+				return false;
+			}
+
+			for (size_t i = 0; i < DependencyCount(); i++)
+			{
+				MeshSourceInfo info;
+				const MeshCacheDependency& dependency = Dependencies()[i];
+				if (!StatMeshSource(DependencyPath(i), info) || info.size != dependency.info.size || info.mtime != dependency.info.mtime)
+				{
+					Close();
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// take ownership of the bytes of a cache file
+		bool Load(std::vector<char> data)
+		{
+			Close();
+			m_memory = std::move(data);
+			if (!Parse(m_memory.data(), m_memory.size()))
+			{
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			m_file.Close();
+			m_memory.clear();
+			m_pHeader = nullptr;
+			m_pData = nullptr;
+			m_iSize = 0;
+			m_pVertices = nullptr;
+			m_iVertexBytes = 0;
+			m_pIndices = nullptr;
+			m_iIndexBytes = 0;
+			m_pSubmeshes = nullptr;
+			m_iSubmeshCount = 0;
+			m_pStrings = nullptr;
+			m_pMaterials = nullptr;
+			m_iMaterialCount = 0;
+			m_pDependencies = nullptr;
+			m_iDependencyCount = 0;
+			m_pStats = nullptr;
+			m_pLods = nullptr;
+			m_iLodRangeCount = 0;
+			m_pLodIndices = nullptr;
+			m_iLodIndexBytes = 0;
+			m_pMeshlets = nullptr;
+			m_iMeshletCount = 0;
+			m_pBvhNodes = nullptr;
+			m_iBvhNodeCount = 0;
+			m_pBvhTriangles = nullptr;
+			m_iBvhTriangleCount = 0;
+		}
+
+		bool IsOpen() const { return m_pHeader != nullptr; }
+
+		// the data of a section, nullptr when the cache doesn't have it
+		const void* Section(MeshCacheSection type, size_t& size) const
+		{
+			const MeshCacheSectionEntry* sections = (const MeshCacheSectionEntry*)(m_pData + sizeof(MeshCacheHeader));
+			for (uint32_t i = 0; i < m_pHeader->numSections; i++)
+			{
+				if (sections[i].type == (uint32_t)type)
+				{
+					size = sections[i].size;
+					return m_pData + sections[i].offset;
+				}
+			}
+			size = 0;
+			return nullptr;
+		}
+
+		const float* Vertices() const { return m_pVertices; }
+		size_t VertexBytes() const { return m_iVertexBytes; }
+		size_t VertexCount() const { return m_iVertexBytes / (m_pHeader->vertexStride * sizeof(float)); }
+		uint32_t VertexStride() const { return m_pHeader->vertexStride; }
+
+		const uint32_t* Indices() const { return m_pIndices; }
+		size_t IndexCount() const { return m_iIndexBytes / sizeof(uint32_t); }
+
+		const MeshCacheSubmesh* Submeshes() const { return m_pSubmeshes; }
+		size_t SubmeshCount() const { return m_iSubmeshCount; }
+		const char* SubmeshName(size_t i) const { return m_pStrings + m_pSubmeshes[i].name; }
+
+		const MeshCacheMaterial* Materials() const { return m_pMaterials; }
+		size_t MaterialCount() const { return m_iMaterialCount; }
+		const char* MaterialName(size_t i) const { return m_pStrings + m_pMaterials[i].name; }
+
+		const MeshCacheDependency* Dependencies() const { return m_pDependencies; }
+		size_t DependencyCount() const { return m_iDependencyCount; }
+		const char* DependencyPath(size_t i) const { return m_pStrings + m_pDependencies[i].path; }
+
+		// nullptr for a cache without them
+		const MeshCacheStats* Stats() const { return m_pStats; }
+
+		// level 0 is the mesh itself, every level after it has about half the triangles
+		uint32_t LodCount() const { return m_iSubmeshCount ? 1 + m_iLodRangeCount / m_iSubmeshCount : 1; }
+		// level must be at least 1
+		const LodRange& Lod(uint32_t level, size_t submesh) const { return m_pLods[(level - 1) * m_iSubmeshCount + submesh]; }
+		const uint32_t* LodIndices() const { return m_pLodIndices; }
+		size_t LodIndexCount() const { return m_iLodIndexBytes / sizeof(uint32_t); }
+
+		const Meshlet* Meshlets() const { return m_pMeshlets; }
+		size_t MeshletCount() const { return m_iMeshletCount; }
+
+		// empty for a cache without one
+		const BvhNode* BvhNodes() const { return m_pBvhNodes; }
+		size_t BvhNodeCount() const { return m_iBvhNodeCount; }
+		const uint32_t* BvhTriangles() const { return m_pBvhTriangles; }
+
+		// the closest triangle of the mesh along a ray in model space
+		bool Intersect(const float origin[3], const float direction[3], BvhHit& hit) const
+		{
+			return IntersectBvh(m_pBvhNodes, m_iBvhNodeCount, m_pBvhTriangles, m_pVertices, VertexStride(), m_pIndices, origin, direction, hit);
+		}
+
+		const float* BoundsMin() const { return m_pHeader->boundsMin; }
+		const float* BoundsMax() const { return m_pHeader->boundsMax; }
+
+	private:
+		bool Parse(const char* data, size_t size)
+		{
+			if (size < sizeof(MeshCacheHeader))
+				return false;
+			const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+			if (memcmp(header->magic, MESH_CACHE_MAGIC, 4) != 0 || header->version != MESH_CACHE_VERSION)
+				return false;
+			if (size < sizeof(MeshCacheHeader) + header->numSections * sizeof(MeshCacheSectionEntry))
+				return false;
+
+			const MeshCacheSectionEntry* sections = (const MeshCacheSectionEntry*)(data + sizeof(MeshCacheHeader));
+			for (uint32_t i = 0; i < header->numSections; i++)
+			{
+				if (sections[i].offset > size || sections[i].size > size - sections[i].offset)
+					return false;
+			}
+
+			m_pHeader = header;
+			m_pData = data;
+			m_iSize = size;
+			m_pVertices = (const float*)Section(MeshCacheSection::Vertices, m_iVertexBytes);
+			m_pIndices = (const uint32_t*)Section(MeshCacheSection::Indices, m_iIndexBytes);
+			if (!m_pVertices || !m_pIndices || header->vertexStride == 0)
+			{
+				m_pHeader = nullptr;
+				return false;
+			}
+
+			size_t submeshBytes, stringBytes, materialBytes;
+			m_pSubmeshes = (const MeshCacheSubmesh*)Section(MeshCacheSection::Submeshes, submeshBytes);
+			m_pStrings = (const char*)Section(MeshCacheSection::Strings, stringBytes);
+			m_pMaterials = (const MeshCacheMaterial*)Section(MeshCacheSection::Materials, materialBytes);
+			m_iSubmeshCount = submeshBytes / sizeof(MeshCacheSubmesh);
+			m_iMaterialCount = materialBytes / sizeof(MeshCacheMaterial);
+			size_t dependencyBytes;
+			m_pDependencies = (const MeshCacheDependency*)Section(MeshCacheSection::Dependencies, dependencyBytes);
+			m_iDependencyCount = dependencyBytes / sizeof(MeshCacheDependency);
+			size_t statsBytes;
+			m_pStats = (const MeshCacheStats*)Section(MeshCacheSection::Stats, statsBytes);
+			if (statsBytes < sizeof(MeshCacheStats))
+				m_pStats = nullptr;
+			size_t lodBytes;
+			m_pLods = (const LodRange*)Section(MeshCacheSection::Lods, lodBytes);
+			m_pLodIndices = (const uint32_t*)Section(MeshCacheSection::LodIndices, m_iLodIndexBytes);
+			m_iLodRangeCount = m_iSubmeshCount ? lodBytes / sizeof(LodRange) / m_iSubmeshCount * m_iSubmeshCount : 0;
+			size_t meshletBytes;
+			m_pMeshlets = (const Meshlet*)Section(MeshCacheSection::Meshlets, meshletBytes);
+			m_iMeshletCount = meshletBytes / sizeof(Meshlet);
+			size_t bvhNodeBytes, bvhTriangleBytes;
+			m_pBvhNodes = (const BvhNode*)Section(MeshCacheSection::BvhNodes, bvhNodeBytes);
+			m_pBvhTriangles = (const uint32_t*)Section(MeshCacheSection::BvhTriangles, bvhTriangleBytes);
+			m_iBvhNodeCount = bvhNodeBytes / sizeof(BvhNode);
+			m_iBvhTriangleCount = bvhTriangleBytes / sizeof(uint32_t);
+
+			bool valid = stringBytes > 0 && m_pStrings[stringBytes - 1] == '\0';
+			for (size_t i = 0; valid && i < m_iSubmeshCount; i++)
+			{
+				const MeshCacheSubmesh& submesh = m_pSubmeshes[i];
+				valid = submesh.name < stringBytes && submesh.material < m_iMaterialCount
+					&& (uint64_t)submesh.firstIndex + submesh.indexCount <= IndexCount()
+					&& (uint64_t)submesh.firstMeshlet + submesh.meshletCount <= m_iMeshletCount;
+			}
+			for (size_t i = 0; valid && i < m_iMaterialCount; i++)
+				valid = m_pMaterials[i].name < stringBytes;
+			for (size_t i = 0; valid && i < m_iDependencyCount; i++)
+				valid = m_pDependencies[i].path < stringBytes;
+			for (size_t i = 0; valid && i < m_iLodRangeCount; i++)
+				valid = (uint64_t)m_pLods[i].firstIndex + m_pLods[i].indexCount <= LodIndexCount();
+			for (size_t i = 0; valid && i < m_iMeshletCount; i++)
+				valid = (uint64_t)m_pMeshlets[i].firstIndex + m_pMeshlets[i].indexCount <= IndexCount();
+			// traversal trusts every child and triangle number it reads
+			for (size_t i = 0; valid && i < m_iBvhNodeCount; i++)
+			{
+				const BvhNode& node = m_pBvhNodes[i];
+				valid = node.IsLeaf() ? (uint64_t)node.leftFirst + node.count <= m_iBvhTriangleCount
+					: node.leftFirst > i && (uint64_t)node.leftFirst + 1 < m_iBvhNodeCount;
+			}
+			for (size_t i = 0; valid && i < m_iBvhTriangleCount; i++)
+				valid = m_pBvhTriangles[i] < IndexCount() / 3;
+			// the same goes for every vertex the indices point at
+			size_t numVertices = VertexCount();
+			for (size_t i = 0; valid && i < IndexCount(); i++)
+				valid = m_pIndices[i] < numVertices;
+			for (size_t i = 0; valid && i < LodIndexCount(); i++)
+				valid = m_pLodIndices[i] < numVertices;
+			if (!valid)
+			{
+				m_pHeader = nullptr;
+				return false;
+			}
+			return true;
+		}
+
+		MappedFile m_file;
+		std::vector<char> m_memory;
+		const MeshCacheHeader* m_pHeader = nullptr;
+		const char* m_pData = nullptr;
+		size_t m_iSize = 0;
+
+		const float* m_pVertices = nullptr;
+		size_t m_iVertexBytes = 0;
+		const uint32_t* m_pIndices = nullptr;
+		size_t m_iIndexBytes = 0;
+		const MeshCacheSubmesh* m_pSubmeshes = nullptr;
+		size_t m_iSubmeshCount = 0;
+		const char* m_pStrings = nullptr;
+		const MeshCacheMaterial* m_pMaterials = nullptr;
+		size_t m_iMaterialCount = 0;
+		const MeshCacheDependency* m_pDependencies = nullptr;
+		size_t m_iDependencyCount = 0;
+		const MeshCacheStats* m_pStats = nullptr;
+		const LodRange* m_pLods = nullptr;
+		size_t m_iLodRangeCount = 0;
+		const uint32_t* m_pLodIndices = nullptr;
+		size_t m_iLodIndexBytes = 0;
+		const Meshlet* m_pMeshlets = nullptr;
+		size_t m_iMeshletCount = 0;
+		const BvhNode* m_pBvhNodes = nullptr;
+		size_t m_iBvhNodeCount = 0;
+		const uint32_t* m_pBvhTriangles = nullptr;
+		size_t m_iBvhTriangleCount = 0;
+	};
+
+	// write data to filename through a temporary file, so a reader never sees half a cache
+	bool WriteFileAtomic(const std::string& filename, const std::vector<char>& data)
+	{
+		std::string tmp = filename + ".tmp";
+		FILE* fp = fopen(tmp.c_str(), "wb");
+		if (!fp)
+			return false;
+		bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+		ok = fclose(fp) == 0 && ok;
+		if (!ok || rename(tmp.c_str(), filename.c_str()) != 0)
+		{
+			remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// load a model through its cache. when the cache is missing or stale the file is
+	// imported, welded, optionally put in spatial order, normals are generated and a new cache
+	// is written for the next run
+	bool LoadMeshCached(const char* filename, MeshCache& cache, const MeshCacheOptions& options = {})
+	{
+		MeshSourceInfo source;
+		if (!StatMeshSource(filename, source))
+			return false;
+
+		std::string cachePath = MeshCachePath(filename);
+		if (cache.Open(cachePath.c_str(), filename, source, options))
+			return true;
+
+		Mesh mesh = ImportMesh(filename);
+		if (mesh.indices.empty())
+			return false;
+		source.hash = HashFile(filename);
+
+		// exporters split positions along seams, normals have to be generated across them
+		MeshCacheStats stats;
+		float boundsMin[3];
+		float boundsMax[3];
+		ComputeBounds(mesh.positions.data(), mesh.VertexCount(), 3, boundsMin, boundsMax);
+		float extent = std::max({boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]});
+		stats.weldedVertices = WeldMesh(mesh, options.weldEpsilon * extent);
+		stats.vertexCacheBefore = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.VertexCount());
+		// only for normal generation, the passes after it pick their own triangle and vertex order
+		if (options.spatialOrder)
+			SpatialOrderMesh(mesh);
+
+		std::vector<float> vertices = BuildVertexBuffer(mesh);
+
+		// reorder for the vertex cache, overdraw and vertex fetch once, here, so it's free afterwards
+		OptimizeMesh(vertices, 6, mesh.indices, mesh.submeshes);
+		// meshlets change the triangle order, the vertices are put back in first use order after
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> firstMeshlet;
+		BuildMeshlets(vertices, 6, mesh.indices, mesh.submeshes, meshlets, firstMeshlet);
+		OptimizeVertexFetch(vertices, 6, mesh.indices);
+		stats.vertexCacheAfter = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), vertices.size() / 6);
+		Bvh bvh = BuildBvh(vertices.data(), 6, mesh.indices.data(), mesh.indices.size());
+
+		// the levels share the optimized vertex buffer, only their indices are new
+		std::vector<uint32_t> lodIndices;
+		std::vector<LodRange> lods;
+		BuildLodChain(vertices, 6, mesh.indices, mesh.submeshes, lodIndices, lods);
+		MeshCacheHeader header = {};
+		header.source = source;
+		header.vertexStride = 6;
+		header.weldEpsilon = options.weldEpsilon;
+		header.spatialOrder = options.spatialOrder;
+		ComputeBounds(vertices.data(), vertices.size() / 6, 6, header.boundsMin, header.boundsMax);
+
+		std::vector<MeshCacheSubmesh> submeshes;
+		std::string strings;
+		for (size_t i = 0; i < mesh.submeshes.size(); i++)
+		{
+			const Submesh& submesh = mesh.submeshes[i];
+			MeshCacheSubmesh out;
+			out.firstIndex = submesh.firstIndex;
+			out.indexCount = submesh.indexCount;
+			memcpy(out.boundsMin, submesh.boundsMin, sizeof(out.boundsMin));
+			memcpy(out.boundsMax, submesh.boundsMax, sizeof(out.boundsMax));
+			out.name = strings.size();
+			strings.append(submesh.name).push_back('\0');
+			out.material = submesh.material;
+			out.firstMeshlet = firstMeshlet[i];
+			out.meshletCount = firstMeshlet[i + 1] - firstMeshlet[i];
+			submeshes.push_back(out);
+		}
+
+		std::vector<MeshCacheMaterial> materials;
+		for (const Material& material : mesh.materials)
+		{
+			MeshCacheMaterial out;
+			out.name = strings.size();
+			strings.append(material.name).push_back('\0');
+			memcpy(out.color, material.color, sizeof(out.color));
+			out.ambient = material.ambient;
+			out.specular = material.specular;
+			out.roughness = material.roughness;
+			materials.push_back(out);
+		}
+
+		std::vector<MeshCacheDependency> dependencies;
+		for (const std::string& library : mesh.materialLibraries)
+		{
+			MeshCacheDependency out = {};
+			if (!StatMeshSource(library.c_str(), out.info))
+				continue;
+			out.path = strings.size();
+			strings.append(library).push_back('\0');
+			dependencies.push_back(out);
+		}
+
+		MeshCacheWriter writer;
+		writer.AddSection(MeshCacheSection::Vertices, vertices.data(), vertices.size() * sizeof(float));
+		writer.AddSection(MeshCacheSection::Indices, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		writer.AddSection(MeshCacheSection::Submeshes, submeshes.data(), submeshes.size() * sizeof(MeshCacheSubmesh));
+		writer.AddSection(MeshCacheSection::Strings, strings.data(), strings.size());
+		writer.AddSection(MeshCacheSection::Materials, materials.data(), materials.size() * sizeof(MeshCacheMaterial));
+		writer.AddSection(MeshCacheSection::Dependencies, dependencies.data(), dependencies.size() * sizeof(MeshCacheDependency));
+		writer.AddSection(MeshCacheSection::Stats, &stats, sizeof(stats));
+		writer.AddSection(MeshCacheSection::Lods, lods.data(), lods.size() * sizeof(LodRange));
+		writer.AddSection(MeshCacheSection::LodIndices, lodIndices.data(), lodIndices.size() * sizeof(uint32_t));
+		writer.AddSection(MeshCacheSection::Meshlets, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+		writer.AddSection(MeshCacheSection::BvhNodes, bvh.nodes.data(), bvh.nodes.size() * sizeof(BvhNode));
+		writer.AddSection(MeshCacheSection::BvhTriangles, bvh.triangles.data(), bvh.triangles.size() * sizeof(uint32_t));
+		std::vector<char> data = writer.Finish(header);
+
+		// not being able to write the cache (read only assets) only costs the next startup
+		WriteFileAtomic(cachePath, data);
+		return cache.Load(std::move(data));
+	}
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "mesh.h"
+#include "thread_pool.h"
+#include "vertex_cache.h"
+
+namespace Util
+{
+
+	// small enough that culling one is worth it, big enough that the cpu isn't busy culling
+	constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+	constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+	// a cluster of neighbouring triangles, a range of the index buffer
+	struct Meshlet
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float center[3]; // bounding sphere
+		float radius;
+		// every triangle faces away from a camera inside the cone around -axis at apex
+		// that opens by acos(cutoff), see ConeBackfacing. cutoff > 1 when they face too many ways
+		float coneApex[3];
+		float coneCutoff;
+		float coneAxis[3];
+		uint32_t vertexCount;
+	};
+
+	// bounding sphere and normal cone of the triangles in indices, positions the first
+	// 3 floats of every stride
+	void ComputeMeshletBounds(const float* vertices, size_t stride, const uint32_t* indices, size_t numIndices, Meshlet& meshlet)
+	{
+		auto position = [&](uint32_t v) { return vertices + v * stride; };
+
+		// ritter's sphere: start between the two vertices furthest apart along x, grow to fit
+		const float* lo = position(indices[0]);
+		const float* hi = lo;
+		for (size_t i = 1; i < numIndices; i++)
+		{
+			const float* p = position(indices[i]);
+			lo = p[0] < lo[0] ? p : lo;
+			hi = p[0] > hi[0] ? p : hi;
+		}
+		float center[3] = {(lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f};
+		float radius = 0.5f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+		for (size_t i = 0; i < numIndices; i++)
+		{
+			const float* p = position(indices[i]);
+			float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+			float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (distance <= radius)
+				continue;
+			float grow = (distance - radius) * 0.5f;
+			for (int c = 0; c < 3; c++)
+				center[c] += d[c] / distance * grow;
+			radius += grow;
+		}
+		std::copy(center, center + 3, meshlet.center);
+		meshlet.radius = radius;
+
+		std::vector<float> normals(numIndices);
+		float axis[3] = {0, 0, 0};
+		for (size_t t = 0; t < numIndices / 3; t++)
+		{
+			const float* p0 = position(indices[t * 3]);
+			const float* p1 = position(indices[t * 3 + 1]);
+			const float* p2 = position(indices[t * 3 + 2]);
+			float a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float* n = &normals[t * 3];
+			n[0] = a[1] * b[2] - a[2] * b[1];
+			n[1] = a[2] * b[0] - a[0] * b[2];
+			n[2] = a[0] * b[1] - a[1] * b[0];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int c = 0; c < 3; c++)
+			{
+				n[c] = length > 0 ? n[c] / length : 0;
+				axis[c] += n[c];
+			}
+		}
+		float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		for (int c = 0; c < 3; c++)
+			meshlet.coneAxis[c] = length > 0 ? axis[c] / length : 0;
+		std::copy(center, center + 3, meshlet.coneApex);
+		meshlet.coneCutoff = 2;
+
+		float minDot = 1;
+		for (size_t t = 0; t < numIndices / 3; t++)
+		{
+			const float* n = &normals[t * 3];
+			minDot = std::min(minDot, n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2]);
+		}
+		// a cone of more than 90 degrees can't be culled from anywhere
+		if (length <= 0 || minDot <= 0.01f)
+			return;
+
+		// move the apex back along the axis until it's behind every triangle's plane
+		float maxT = 0;
+		for (size_t t = 0; t < numIndices / 3; t++)
+		{
+			const float* n = &normals[t * 3];
+			const float* p0 = position(indices[t * 3]);
+			float dc = (center[0] - p0[0]) * n[0] + (center[1] - p0[1]) * n[1] + (center[2] - p0[2]) * n[2];
+			float dn = n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2];
+			if (dn > 0)
+				maxT = std::max(maxT, dc / dn);
+		}
+		for (int c = 0; c < 3; c++)
+			meshlet.coneApex[c] = center[c] - meshlet.coneAxis[c] * maxT;
+		meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+	}
+
+	// split the triangles in indices into meshlets, growing each one from a seed triangle by
+	// the neighbours that add the fewest new vertices and bend its normal cone the least.
+	// the triangles are rewritten in meshlet order, the meshlets' firstIndex is relative to indices
+	void BuildMeshlets(const float* vertices, size_t stride, uint32_t* indices, size_t numIndices, std::vector<Meshlet>& meshlets)
+	{
+		meshlets.clear();
+		size_t numTriangles = numIndices / 3;
+		if (numTriangles == 0)
+			return;
+
+		std::vector<uint32_t> local;
+		std::vector<uint32_t> global;
+		CompactIndices(indices, numTriangles * 3, local, global);
+		size_t numVertices = global.size();
+
+		std::vector<uint32_t> offsets(numVertices + 1, 0);
+		for (uint32_t v : local)
+			offsets[v + 1]++;
+		for (size_t v = 0; v < numVertices; v++)
+			offsets[v + 1] += offsets[v];
+		std::vector<uint32_t> adjacency(local.size());
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < local.size(); i++)
+				adjacency[cursor[local[i]]++] = i / 3;
+		}
+
+		std::vector<float> normals(numTriangles * 3);
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			const float* p0 = vertices + indices[t * 3] * stride;
+			const float* p1 = vertices + indices[t * 3 + 1] * stride;
+			const float* p2 = vertices + indices[t * 3 + 2] * stride;
+			float a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float* n = &normals[t * 3];
+			n[0] = a[1] * b[2] - a[2] * b[1];
+			n[1] = a[2] * b[0] - a[0] * b[2];
+			n[2] = a[0] * b[1] - a[1] * b[0];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int c = 0; c < 3; c++)
+				n[c] = length > 0 ? n[c] / length : 0;
+		}
+
+		// which meshlet each vertex was last added to, so membership is a single compare
+		std::vector<uint32_t> vertexMeshlet(numVertices, UINT32_MAX);
+		std::vector<bool> used(numTriangles, false);
+		std::vector<uint32_t> meshletVertices;
+		// the unused triangles touching the meshlet, only these can grow it
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> candidateMeshlet(numTriangles, UINT32_MAX);
+		std::vector<uint32_t> out;
+		out.reserve(numTriangles * 3);
+		size_t seed = 0;
+
+		while (true)
+		{
+			while (seed < numTriangles && used[seed])
+				seed++;
+			if (seed == numTriangles)
+				break;
+
+			uint32_t id = meshlets.size();
+			size_t firstIndex = out.size();
+			meshletVertices.clear();
+			candidates.clear();
+			float axis[3] = {0, 0, 0};
+			auto add = [&](uint32_t t)
+			{
+				used[t] = true;
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t v = local[t * 3 + k];
+					if (vertexMeshlet[v] != id)
+					{
+						vertexMeshlet[v] = id;
+						meshletVertices.push_back(v);
+						for (uint32_t a = offsets[v]; a < offsets[v + 1]; a++)
+						{
+							uint32_t neighbour = adjacency[a];
+							if (!used[neighbour] && candidateMeshlet[neighbour] != id)
+							{
+								candidateMeshlet[neighbour] = id;
+								candidates.push_back(neighbour);
+							}
+						}
+					}
+					out.push_back(v);
+				}
+				for (int c = 0; c < 3; c++)
+					axis[c] += normals[t * 3 + c];
+			};
+			add(seed);
+
+			while ((out.size() - firstIndex) / 3 < MESHLET_MAX_TRIANGLES)
+			{
+				float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+				int64_t best = -1;
+				float bestScore = 0;
+				for (size_t c = 0; c < candidates.size();)
+				{
+					uint32_t t = candidates[c];
+					if (used[t])
+					{
+						candidates[c] = candidates.back();
+						candidates.pop_back();
+						continue;
+					}
+					c++;
+					uint32_t extra = 0;
+					for (int k = 0; k < 3; k++)
+						extra += vertexMeshlet[local[t * 3 + k]] != id;
+					if (meshletVertices.size() + extra > MESHLET_MAX_VERTICES)
+						continue;
+					const float* n = &normals[t * 3];
+					float spread = length > 0 ? 1 - (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / length : 0;
+					float score = extra + spread;
+					if (best < 0 || score < bestScore)
+					{
+						best = t;
+						bestScore = score;
+					}
+				}
+				if (best < 0)
+					break;
+				add(best);
+			}
+
+			// the triangles within a meshlet in vertex cache order
+			std::vector<uint32_t> clusters;
+			std::vector<uint32_t> meshletLocal;
+			std::vector<uint32_t> meshletGlobal;
+			CompactIndices(&out[firstIndex], out.size() - firstIndex, meshletLocal, meshletGlobal);
+			OptimizeVertexCache(meshletLocal.data(), meshletLocal.size(), meshletGlobal.size(), clusters);
+			for (size_t i = 0; i < meshletLocal.size(); i++)
+				out[firstIndex + i] = global[meshletGlobal[meshletLocal[i]]];
+
+			Meshlet meshlet;
+			meshlet.firstIndex = firstIndex;
+			meshlet.indexCount = out.size() - firstIndex;
+			meshlet.vertexCount = meshletVertices.size();
+			ComputeMeshletBounds(vertices, stride, &out[firstIndex], meshlet.indexCount, meshlet);
+			meshlets.push_back(meshlet);
+		}
+		std::copy(out.begin(), out.end(), indices);
+	}
+
+	// meshlets for every submesh, in submesh order with firstIndex into the whole index buffer.
+	// firstMeshlet gets where each submesh's meshlets start, with one extra entry at the end
+	void BuildMeshlets(const std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes,
+		std::vector<Meshlet>& meshlets, std::vector<uint32_t>& firstMeshlet)
+	{
+		std::vector<std::vector<Meshlet>> perSubmesh(submeshes.size());
+		GetThreadPool().ParallelFor(submeshes.size(), [&](size_t i)
+		{
+			BuildMeshlets(vertices.data(), stride, &indices[submeshes[i].firstIndex], submeshes[i].indexCount, perSubmesh[i]);
+			for (Meshlet& meshlet : perSubmesh[i])
+				meshlet.firstIndex += submeshes[i].firstIndex;
+		});
+
+		meshlets.clear();
+		firstMeshlet.clear();
+		for (const std::vector<Meshlet>& list : perSubmesh)
+		{
+			firstMeshlet.push_back(meshlets.size());
+			meshlets.insert(meshlets.end(), list.begin(), list.end());
+		}
+		firstMeshlet.push_back(meshlets.size());
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cmath>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "mesh.h"
+#include "parse.h"
+
+namespace Util
+{
+
+	// the index of the material called name, added with default values if there is none yet
+	uint32_t FindMaterial(std::vector<Material>& materials, const std::string& name)
+	{
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			if (materials[i].name == name)
+				return i;
+		}
+		Material material;
+		material.name = name;
+		materials.push_back(material);
+		return materials.size() - 1;
+	}
+
+	// read the materials of an mtl file into materials, replacing ones with the same name.
+	// Kd and d give the color, the averages of Ka and Ks the ambient and specular factors,
+	// and the exponent Ns maps back to roughness the way blender exports it (Ns = 1000 * (1 - r)^2)
+	bool LoadMtl(const char* filename, std::vector<Material>& materials)
+	{
+		MappedFile file;
+		if (!file.Open(filename))
+			return false;
+
+		Material* current = nullptr;
+		ForEachLine(file.Data(), file.End(), [&](const char* begin, const char* end)
+		{
+			const char* p = SkipSpaces(begin, end);
+			const char* type = p;
+			p = SkipToken(p, end);
+			std::string key(type, p);
+
+			// the name is the rest of the line, even when it starts like a number
+			if (key == "newmtl")
+			{
+				p = SkipSpaces(p, end);
+				const char* nameEnd = end;
+				while (nameEnd > p && IsSpace(nameEnd[-1]))
+					--nameEnd;
+				uint32_t index = FindMaterial(materials, std::string(p, nameEnd));
+				materials[index] = Material();
+				materials[index].name = std::string(p, nameEnd);
+				current = &materials[index];
+				return;
+			}
+
+			float values[3] = {0, 0, 0};
+			int numValues = 0;
+			for (; numValues < 3; numValues++)
+			{
+				p = SkipSpaces(p, end);
+				if (!ParseFloat(p, end, values[numValues]))
+					break;
+			}
+
+			if (!current || numValues == 0)
+				return;
+			else if (key == "Kd")
+			{
+				for (int i = 0; i < 3; i++)
+					current->color[i] = numValues == 3 ? values[i] : values[0];
+			}
+			else if (key == "d")
+				current->color[3] = values[0];
+			else if (key == "Tr")
+				current->color[3] = 1 - values[0];
+			else if (key == "Ka")
+				current->ambient = numValues == 3 ? (values[0] + values[1] + values[2]) / 3 : values[0];
+			else if (key == "Ks")
+				current->specular = numValues == 3 ? (values[0] + values[1] + values[2]) / 3 : values[0];
+			else if (key == "Ns")
+				current->roughness = 1 - std::sqrt(std::fmin(std::fmax(values[0] / 1000, 0.0f), 1.0f));
+		});
+		return true;
+	}
+}
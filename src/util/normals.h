@@ -0,0 +1,365 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	constexpr size_t NORMALS_PARALLEL_BLOCK = 1 << 14;
+
+	// the triangles around each vertex: vertex v touches triangles[offsets[v]..offsets[v + 1]),
+	// listed in increasing order so anything summed over them comes out the same every run
+	struct VertexAdjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		size_t VertexCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+		const uint32_t* Begin(uint32_t v) const { return triangles.data() + offsets[v]; }
+		const uint32_t* End(uint32_t v) const { return triangles.data() + offsets[v + 1]; }
+	};
+
+	// indices that are out of range are skipped. every thread owns a range of vertices and
+	// scans all the indices for its own, no atomics and the lists come out sorted by themselves
+	VertexAdjacency BuildVertexAdjacency(size_t numVertices, const std::vector<uint32_t>& indices)
+	{
+		VertexAdjacency adjacency;
+		size_t numCorners = indices.size() / 3 * 3;
+		size_t numRanges = std::max<size_t>(1, std::min<size_t>(GetThreadPool().NumThreads(), numVertices / NORMALS_PARALLEL_BLOCK));
+		size_t rangeSize = std::max<size_t>(1, (numVertices + numRanges - 1) / numRanges);
+
+		adjacency.offsets.assign(numVertices + 1, 0);
+		uint32_t* offsets = adjacency.offsets.data();
+		ParallelBlocks(numVertices, rangeSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = 0; i < numCorners; i++)
+			{
+				uint32_t v = indices[i];
+				if (v >= begin && v < end)
+					offsets[v + 1]++;
+			}
+		});
+		for (size_t v = 0; v < numVertices; v++)
+			offsets[v + 1] += offsets[v];
+
+		adjacency.triangles.resize(offsets[numVertices]);
+		std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		ParallelBlocks(numVertices, rangeSize, [&](size_t begin, size_t end)
+		{
+			for (size_t i = 0; i < numCorners; i++)
+			{
+				uint32_t v = indices[i];
+				if (v >= begin && v < end)
+					adjacency.triangles[cursor[v]++] = i / 3;
+			}
+		});
+		return adjacency;
+	}
+
+	// the unnormalized normal of every triangle, its length is twice the area.
+	// triangles with an index out of range get a zero normal
+	void ComputeFaceNormals(const float* positions, size_t numVertices, const uint32_t* indices, size_t begin, size_t end, float* faceNormals)
+	{
+		size_t t = begin;
+#if defined(__SSE2__)
+		// four triangles at a time, gathered into x/y/z lanes
+		for (; t + 4 <= end; t += 4)
+		{
+			alignas(16) float e[4][3][4];
+			bool valid = true;
+			for (int k = 0; k < 4; k++)
+			{
+				const uint32_t* tri = indices + (t + k) * 3;
+				valid &= tri[0] < numVertices && tri[1] < numVertices && tri[2] < numVertices;
+			}
+			if (!valid)
+				break;
+			for (int k = 0; k < 4; k++)
+			{
+				const uint32_t* tri = indices + (t + k) * 3;
+				const float* p0 = positions + tri[0] * 3;
+				const float* p1 = positions + tri[1] * 3;
+				const float* p2 = positions + tri[2] * 3;
+				for (int c = 0; c < 3; c++)
+				{
+					e[0][c][k] = p1[c] - p0[c];
+					e[1][c][k] = p2[c] - p0[c];
+				}
+			}
+			__m128 ax = _mm_load_ps(e[0][0]), ay = _mm_load_ps(e[0][1]), az = _mm_load_ps(e[0][2]);
+			__m128 bx = _mm_load_ps(e[1][0]), by = _mm_load_ps(e[1][1]), bz = _mm_load_ps(e[1][2]);
+			_mm_store_ps(e[2][0], _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+			_mm_store_ps(e[2][1], _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+			_mm_store_ps(e[2][2], _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+			for (int k = 0; k < 4; k++)
+			{
+				faceNormals[(t + k) * 3] = e[2][0][k];
+				faceNormals[(t + k) * 3 + 1] = e[2][1][k];
+				faceNormals[(t + k) * 3 + 2] = e[2][2][k];
+			}
+		}
+#endif
+		for (; t < end; t++)
+		{
+			const uint32_t* tri = indices + t * 3;
+			float* n = faceNormals + t * 3;
+			if (tri[0] >= numVertices || tri[1] >= numVertices || tri[2] >= numVertices)
+			{
+				n[0] = n[1] = n[2] = 0;
+				continue;
+			}
+			const float* p0 = positions + tri[0] * 3;
+			const float* p1 = positions + tri[1] * 3;
+			const float* p2 = positions + tri[2] * 3;
+			float a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			float b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			n[0] = a[1] * b[2] - a[2] * b[1];
+			n[1] = a[2] * b[0] - a[0] * b[2];
+			n[2] = a[0] * b[1] - a[1] * b[0];
+		}
+	}
+
+	// scale n to unit length, vertices without any area around them point up the z axis
+	void NormalizeNormal(float* n)
+	{
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0 && std::isfinite(length))
+		{
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else
+		{
+			n[0] = 0;
+			n[1] = 0;
+			n[2] = 1;
+		}
+	}
+
+	// the area weighted average of the face normals around v, always in the same order
+	void AccumulateVertexNormal(uint32_t v, const VertexAdjacency& adjacency, const float* faceNormals, float* out)
+	{
+		float n[3] = {0, 0, 0};
+		for (const uint32_t* t = adjacency.Begin(v); t != adjacency.End(v); t++)
+		{
+			n[0] += faceNormals[*t * 3];
+			n[1] += faceNormals[*t * 3 + 1];
+			n[2] += faceNormals[*t * 3 + 2];
+		}
+		NormalizeNormal(n);
+		out[0] = n[0];
+		out[1] = n[1];
+		out[2] = n[2];
+	}
+
+	// smooth unit normals, 3 floats per vertex. each vertex gathers its own triangles,
+	// so threads never write to the same vertex and the result doesn't depend on their count
+	std::vector<float> ComputeVertexNormals(const std::vector<float>& positions, const std::vector<uint32_t>& indices)
+	{
+		size_t numVertices = positions.size() / 3;
+		size_t numTriangles = indices.size() / 3;
+
+		std::vector<float> faceNormals(numTriangles * 3);
+		ParallelBlocks(numTriangles, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			ComputeFaceNormals(positions.data(), numVertices, indices.data(), begin, end, faceNormals.data());
+		});
+
+		VertexAdjacency adjacency = BuildVertexAdjacency(numVertices, indices);
+
+		std::vector<float> normals(numVertices * 3);
+		ParallelBlocks(numVertices, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; v++)
+				AccumulateVertexNormal(v, adjacency, faceNormals.data(), &normals[v * 3]);
+		});
+		return normals;
+	}
+
+	// a run of vertices [first, last), what has to be re-uploaded after an update
+	struct VertexRange
+	{
+		uint32_t first = 0;
+		uint32_t last = 0;
+
+		bool Empty() const { return first >= last; }
+		uint32_t Count() const { return Empty() ? 0 : last - first; }
+	};
+
+	// keeps the smooth normals of a mesh whose vertices move but whose triangles don't.
+	// moved vertices are marked dirty and Update recomputes the triangles around them and
+	// the normals of those triangles' corners, so the cost follows the size of the edit
+	class IncrementalNormals
+	{
+	public:
+		// compute every normal from scratch, the indices are kept for later updates
+		void Build(const std::vector<float>& positions, const std::vector<uint32_t>& indices)
+		{
+			size_t numVertices = positions.size() / 3;
+			m_indices = indices;
+			m_indices.resize(indices.size() / 3 * 3);
+			m_adjacency = BuildVertexAdjacency(numVertices, m_indices);
+
+			size_t numTriangles = m_indices.size() / 3;
+			m_faceNormals.resize(numTriangles * 3);
+			ParallelBlocks(numTriangles, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				ComputeFaceNormals(positions.data(), numVertices, m_indices.data(), begin, end, m_faceNormals.data());
+			});
+
+			m_normals.resize(numVertices * 3);
+			ParallelBlocks(numVertices, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+					AccumulateVertexNormal(v, m_adjacency, m_faceNormals.data(), &m_normals[v * 3]);
+			});
+
+			m_vertexMarks.assign(numVertices, 0);
+			m_triangleMarks.assign(numTriangles, 0);
+			m_iMark = 0;
+			m_dirty.clear();
+			NextMark();
+		}
+
+		size_t VertexCount() const { return m_normals.size() / 3; }
+		const std::vector<float>& Normals() const { return m_normals; }
+		bool IsDirty() const { return !m_dirty.empty(); }
+
+		// vertex v has moved since the last update
+		void MarkDirty(uint32_t v)
+		{
+			if (v < m_vertexMarks.size() && m_vertexMarks[v] != m_iMark)
+			{
+				m_vertexMarks[v] = m_iMark;
+				m_dirty.push_back(v);
+			}
+		}
+
+		void MarkDirty(const uint32_t* vertices, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				MarkDirty(vertices[i]);
+		}
+
+		// bring the normals up to date with positions (the same vertex count as Build) and
+		// return the range of vertices whose normals changed
+		VertexRange Update(const std::vector<float>& positions)
+		{
+			VertexRange range;
+			if (m_dirty.empty() || positions.size() != m_normals.size())
+				return range;
+			NextMark();
+
+			// the triangles touching a moved vertex, and every corner of those that is in range
+			size_t numVertices = VertexCount();
+			m_triangles.clear();
+			m_ring.clear();
+			for (uint32_t v : m_dirty)
+			{
+				for (const uint32_t* t = m_adjacency.Begin(v); t != m_adjacency.End(v); t++)
+				{
+					if (m_triangleMarks[*t] == m_iMark)
+						continue;
+					m_triangleMarks[*t] = m_iMark;
+					m_triangles.push_back(*t);
+					for (int k = 0; k < 3; k++)
+					{
+						uint32_t corner = m_indices[*t * 3 + k];
+						if (corner < numVertices && m_vertexMarks[corner] != m_iMark)
+						{
+							m_vertexMarks[corner] = m_iMark;
+							m_ring.push_back(corner);
+						}
+					}
+				}
+			}
+
+			for (uint32_t t : m_triangles)
+				ComputeFaceNormals(positions.data(), numVertices, m_indices.data(), t, t + 1, m_faceNormals.data());
+
+			range.first = UINT32_MAX;
+			for (uint32_t v : m_ring)
+			{
+				AccumulateVertexNormal(v, m_adjacency, m_faceNormals.data(), &m_normals[v * 3]);
+				range.first = std::min(range.first, v);
+				range.last = std::max(range.last, v + 1);
+			}
+			if (m_ring.empty())
+				range.first = 0;
+
+			m_dirty.clear();
+			NextMark();
+			return range;
+		}
+
+		// write the normals of range into an interleaved vertex buffer, stride and offset in floats
+		void CopyNormals(VertexRange range, float* vertices, size_t stride, size_t offset) const
+		{
+			for (uint32_t v = range.first; v < range.last; v++)
+				std::copy(&m_normals[v * 3], &m_normals[v * 3] + 3, vertices + v * stride + offset);
+		}
+
+	private:
+		// marks say "seen in this pass" without having to clear anything between passes
+		void NextMark()
+		{
+			if (++m_iMark == 0)
+			{
+				std::fill(m_vertexMarks.begin(), m_vertexMarks.end(), 0);
+				std::fill(m_triangleMarks.begin(), m_triangleMarks.end(), 0);
+				m_iMark = 1;
+			}
+		}
+
+		std::vector<uint32_t> m_indices;
+		VertexAdjacency m_adjacency;
+		std::vector<float> m_faceNormals;
+		std::vector<float> m_normals;
+
+		std::vector<uint32_t> m_vertexMarks;
+		std::vector<uint32_t> m_triangleMarks;
+		uint32_t m_iMark = 0;
+		std::vector<uint32_t> m_dirty;
+		std::vector<uint32_t> m_triangles;
+		std::vector<uint32_t> m_ring;
+	};
+
+	// interleave positions and normals, 6 floats per vertex
+	std::vector<float> InterleaveNormals(const std::vector<float>& positions, const std::vector<float>& normals)
+	{
+		size_t numVertices = positions.size() / 3;
+		std::vector<float> out(numVertices * 6);
+		ParallelBlocks(numVertices, NORMALS_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				std::copy(&positions[i * 3], &positions[i * 3] + 3, &out[i * 6]);
+				std::copy(&normals[i * 3], &normals[i * 3] + 3, &out[i * 6 + 3]);
+			}
+		});
+		return out;
+	}
+
+	// interleaved pos+normal vertices with smooth normals generated from the triangles
+	std::vector<float> GenerateNormals(const std::vector<float>& vertices, const std::vector<uint32_t>& indices)
+	{
+		return InterleaveNormals(vertices, ComputeVertexNormals(vertices, indices));
+	}
+
+	// interleave a mesh into the pos+normal vertices the shader takes,
+	// generating smooth normals when the file didn't have any
+	std::vector<float> BuildVertexBuffer(const Mesh& mesh)
+	{
+		if (mesh.normals.size() != mesh.positions.size())
+			return GenerateNormals(mesh.positions, mesh.indices);
+		return InterleaveNormals(mesh.positions, mesh.normals);
+	}
+}
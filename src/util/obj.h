@@ -0,0 +1,546 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "index_map.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mtl.h"
+#include "parse.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	// an "o", "g", "usemtl" or "mtllib" line, everything from corner on belongs to it
+	struct ObjMarker
+	{
+		size_t corner;
+		char type; // 'o', 'g', 'm' (usemtl) or 'l' (mtllib)
+		std::string name;
+	};
+
+	// the raw contents of an obj file: the attribute streams exactly as listed in the file and
+	// the v, vt and vn index of every triangle corner. indices are 0 based, -1 when a corner
+	// doesn't reference that stream. the vt and vn index arrays stay empty until some face
+	// references them, so plain "f a b c" files don't pay for them
+	struct ObjData
+	{
+		std::vector<float> positions; // x, y, z
+		std::vector<float> texCoords; // u, v
+		std::vector<float> normals;   // x, y, z
+		std::vector<int32_t> corners[3]; // v, vt and vn indices, 3 per triangle
+		std::vector<ObjMarker> markers; // sorted by corner
+
+		size_t CornerCount() const { return corners[0].size(); }
+	};
+
+	// the part of an obj parsed by one thread. negative (relative) face indices can only be
+	// resolved against the vertices of this chunk, the corners holding such chunk local
+	// indices are remembered (as corner * 3 + stream) so they can be offset once all the
+	// chunk sizes are known
+	struct ObjChunk : ObjData
+	{
+		std::vector<size_t> relative;
+	};
+
+	// read up to count floats from the rest of the line, missing ones are 0
+	void ParseObjFloats(const char* p, const char* end, std::vector<float>& out, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float value = 0;
+			p = SkipSpaces(p, end);
+			if (ParseFloat(p, end, value))
+				p = SkipToken(p, end);
+			out.push_back(value);
+		}
+	}
+
+	// one corner of a face while it is being parsed: the v, vt and vn indices and
+	// which of them are chunk local. plain is set for a bare absolute "v" corner
+	struct ObjFaceCorner
+	{
+		int32_t index[3];
+		bool relative[3];
+		bool plain;
+	};
+
+	// append one triangle corner to chunk.corners
+	void EmitObjCorner(const ObjFaceCorner& corner, ObjChunk& chunk)
+	{
+		size_t cornerIndex = chunk.corners[0].size();
+		chunk.corners[0].push_back(corner.index[0]);
+		// the common case, no vt/vn anywhere so far
+		if (corner.plain && chunk.corners[1].empty() && chunk.corners[2].empty())
+			return;
+
+		if (corner.relative[0])
+			chunk.relative.push_back(cornerIndex * 3);
+		for (int stream = 1; stream < 3; stream++)
+		{
+			auto& corners = chunk.corners[stream];
+			if (corners.size() < cornerIndex)
+			{
+				if (corner.index[stream] == -1)
+					continue;
+				// first reference to this stream, the corners before didn't have one
+				corners.resize(cornerIndex, -1);
+			}
+			if (corner.relative[stream])
+				chunk.relative.push_back(cornerIndex * 3 + stream);
+			corners.push_back(corner.index[stream]);
+		}
+	}
+
+	// parse one face, "f v v v ...", "f v/vt ...", "f v//vn ..." or "f v/vt/vn ...",
+	// and fan triangulate it into chunk.corners
+	void ParseObjFace(const char* p, const char* end, ObjChunk& chunk)
+	{
+		ObjFaceCorner first, previous, current;
+		size_t numCorners = 0;
+
+		while ((p = SkipSpaces(p, end)) < end)
+		{
+			current.plain = true;
+			for (int stream = 0; stream < 3; stream++)
+			{
+				current.index[stream] = -1;
+				current.relative[stream] = false;
+
+				int64_t value;
+				// the position is required, the other two may be left empty
+				if (p < end && *p != '/' && ParseInt(p, end, value))
+				{
+					// 1 based, or negative counting back from the last vertex read so far. 0 is invalid
+					if (value > 0)
+						current.index[stream] = (int32_t)(value - 1);
+					else if (value < 0)
+					{
+						size_t counts[3] = {chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3};
+						current.index[stream] = (int32_t)(counts[stream] + value);
+						current.relative[stream] = true;
+						current.plain = false;
+					}
+					else
+						return;
+				}
+				else if (stream == 0)
+					return;
+
+				if (p == end || *p != '/')
+				{
+					for (stream++; stream < 3; stream++)
+					{
+						current.index[stream] = -1;
+						current.relative[stream] = false;
+					}
+					break;
+				}
+				++p;
+				current.plain = false;
+			}
+			p = SkipToken(p, end);
+
+			if (numCorners == 0)
+				first = current;
+			else if (numCorners >= 2)
+			{
+				EmitObjCorner(first, chunk);
+				EmitObjCorner(previous, chunk);
+				EmitObjCorner(current, chunk);
+			}
+			previous = current;
+			numCorners++;
+		}
+	}
+
+	// parse a single line of an obj file into chunk.
+	// [begin, end) is the line without its '\n'
+	void ParseObjLine(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		const char* p = SkipSpaces(begin, end);
+		const char* type = p;
+		p = SkipToken(p, end);
+		size_t typeLen = p - type;
+
+		if (typeLen == 1 && type[0] == 'v')
+			ParseObjFloats(p, end, chunk.positions, 3);
+		else if (typeLen == 2 && type[0] == 'v' && type[1] == 't')
+			ParseObjFloats(p, end, chunk.texCoords, 2);
+		else if (typeLen == 2 && type[0] == 'v' && type[1] == 'n')
+			ParseObjFloats(p, end, chunk.normals, 3);
+		else if (typeLen == 1 && type[0] == 'f')
+			ParseObjFace(p, end, chunk);
+		else if ((typeLen == 1 && (type[0] == 'o' || type[0] == 'g')) || (typeLen == 6 && memcmp(type, "usemtl", 6) == 0))
+		{
+			// the name is the rest of the line, spaces included
+			p = SkipSpaces(p, end);
+			const char* nameEnd = end;
+			while (nameEnd > p && IsSpace(nameEnd[-1]))
+				--nameEnd;
+			chunk.markers.push_back({chunk.CornerCount(), typeLen == 6 ? 'm' : type[0], std::string(p, nameEnd)});
+		}
+		else if (typeLen == 6 && memcmp(type, "mtllib", 6) == 0)
+		{
+			// any number of file names
+			while ((p = SkipSpaces(p, end)) < end)
+			{
+				const char* name = p;
+				p = SkipToken(p, end);
+				chunk.markers.push_back({chunk.CornerCount(), 'l', std::string(name, p)});
+			}
+		}
+		// smoothing groups ("s") are ignored, normals are generated from the geometry
+	}
+
+	// make every index array either empty or one entry per corner and
+	// drop the triangles that reference vertices that don't exist
+	void RemoveInvalidCorners(ObjData& data)
+	{
+		int64_t counts[3] = {(int64_t)data.positions.size() / 3, (int64_t)data.texCoords.size() / 2, (int64_t)data.normals.size() / 3};
+		size_t numCorners = data.CornerCount() - data.CornerCount() % 3;
+		for (auto& corners : data.corners)
+		{
+			if (!corners.empty())
+				corners.resize(numCorners, -1);
+		}
+
+		size_t out = 0;
+		size_t marker = 0;
+		for (size_t tri = 0; tri < numCorners; tri += 3)
+		{
+			// the markers move along with the triangles they start at
+			for (; marker < data.markers.size() && data.markers[marker].corner <= tri; marker++)
+				data.markers[marker].corner = out;
+
+			bool valid = true;
+			for (int stream = 0; stream < 3; stream++)
+			{
+				const auto& corners = data.corners[stream];
+				if (corners.empty())
+					continue;
+				for (size_t i = tri; i < tri + 3; i++)
+				{
+					// a missing vt or vn is fine, a missing position can't happen
+					if (corners[i] >= counts[stream] || (corners[i] < 0 && (stream == 0 || corners[i] != -1)))
+						valid = false;
+				}
+			}
+			if (!valid)
+				continue;
+			if (out != tri)
+			{
+				for (auto& corners : data.corners)
+				{
+					if (!corners.empty())
+						std::copy(corners.begin() + tri, corners.begin() + tri + 3, corners.begin() + out);
+				}
+			}
+			out += 3;
+		}
+		for (auto& corners : data.corners)
+		{
+			if (!corners.empty())
+				corners.resize(out);
+		}
+		for (; marker < data.markers.size(); marker++)
+			data.markers[marker].corner = out;
+	}
+
+	// files smaller than this are parsed on the calling thread, splitting them costs more than it saves
+	constexpr size_t OBJ_PARALLEL_CHUNK_SIZE = 1 << 20;
+
+	// parse an in-memory obj on the thread pool. the text is split into line aligned chunks,
+	// each chunk is parsed into its own arrays and those are concatenated in order using
+	// prefix sums of their sizes. positive face indices are absolute and copied as is,
+	// negative ones get the number of vertices in the chunks before added on
+	ObjData ParseObjData(const char* begin, const char* end)
+	{
+		ThreadPool& pool = GetThreadPool();
+
+		size_t numChunks = std::min<size_t>(pool.NumThreads() * 4, (end - begin) / OBJ_PARALLEL_CHUNK_SIZE);
+		if (pool.NumThreads() == 1 || numChunks == 0)
+			numChunks = 1;
+
+		auto ranges = SplitLines(begin, end, numChunks);
+		std::vector<ObjChunk> chunks(ranges.size());
+		pool.ParallelFor(ranges.size(), [&](size_t i)
+		{
+			ForEachLine(ranges[i].first, ranges[i].second, [&](const char* lineBegin, const char* lineEnd)
+			{
+				ParseObjLine(lineBegin, lineEnd, chunks[i]);
+			});
+		});
+
+		ObjData out;
+		if (chunks.size() == 1)
+		{
+			out = std::move((ObjData&)chunks[0]);
+			RemoveInvalidCorners(out);
+			return out;
+		}
+
+		// where each chunk's output starts in the merged arrays
+		struct Offsets { size_t positions = 0, texCoords = 0, normals = 0, corners = 0; };
+		std::vector<Offsets> offsets(chunks.size() + 1);
+		bool hasStream[3] = {true, false, false};
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			offsets[i + 1].positions = offsets[i].positions + chunks[i].positions.size();
+			offsets[i + 1].texCoords = offsets[i].texCoords + chunks[i].texCoords.size();
+			offsets[i + 1].normals = offsets[i].normals + chunks[i].normals.size();
+			offsets[i + 1].corners = offsets[i].corners + chunks[i].CornerCount();
+			for (int stream = 1; stream < 3; stream++)
+				hasStream[stream] |= !chunks[i].corners[stream].empty();
+
+			for (ObjMarker& marker : chunks[i].markers)
+			{
+				marker.corner += offsets[i].corners;
+				out.markers.push_back(std::move(marker));
+			}
+		}
+
+		out.positions.resize(offsets.back().positions);
+		out.texCoords.resize(offsets.back().texCoords);
+		out.normals.resize(offsets.back().normals);
+		for (int stream = 0; stream < 3; stream++)
+		{
+			if (hasStream[stream])
+				out.corners[stream].resize(offsets.back().corners);
+		}
+		pool.ParallelFor(chunks.size(), [&](size_t i)
+		{
+			ObjChunk& chunk = chunks[i];
+			const Offsets& offset = offsets[i];
+			int32_t base[3] = {(int32_t)(offset.positions / 3), (int32_t)(offset.texCoords / 2), (int32_t)(offset.normals / 3)};
+			for (size_t slot : chunk.relative)
+				chunk.corners[slot % 3][slot / 3] += base[slot % 3];
+
+			std::copy(chunk.positions.begin(), chunk.positions.end(), out.positions.begin() + offset.positions);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), out.texCoords.begin() + offset.texCoords);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), out.normals.begin() + offset.normals);
+			for (int stream = 0; stream < 3; stream++)
+			{
+				if (!hasStream[stream])
+					continue;
+				auto& corners = chunk.corners[stream];
+				auto dst = out.corners[stream].begin() + offset.corners;
+				std::copy(corners.begin(), corners.end(), dst);
+				// the chunk never referenced this stream, or stopped referencing it
+				std::fill(dst + corners.size(), dst + chunk.CornerCount(), -1);
+			}
+			// free each chunk as soon as it is merged to keep the peak down
+			chunk = ObjChunk();
+		});
+		RemoveInvalidCorners(out);
+		return out;
+	}
+
+	// parse an already open stream, e.g. a pipe or stdin
+	ObjData ReadObjData(FILE* fp)
+	{
+		ObjChunk chunk;
+		StreamLines(fp, [&](const char* begin, const char* end)
+		{
+			ParseObjLine(begin, end, chunk);
+		});
+		// a single chunk starts at vertex 0, its local indices are already absolute
+		ObjData out = std::move((ObjData&)chunk);
+		RemoveInvalidCorners(out);
+		return out;
+	}
+
+	// read an obj file. regular files are memory mapped and parsed in parallel (see SetThreadCount),
+	// anything else (and "-" for stdin) is streamed, so there is no limit on the file size
+	ObjData LoadObjData(const char* filename)
+	{
+		if (strcmp(filename, "-") == 0)
+			return ReadObjData(stdin);
+
+		MappedFile file;
+		if (file.Open(filename))
+			return ParseObjData(file.Data(), file.End());
+
+		ObjData out;
+		FILE* fp = fopen(filename, "rb");
+		if (!fp)
+			return out;
+		out = ReadObjData(fp);
+		fclose(fp);
+		return out;
+	}
+
+	struct ObjCornerKey
+	{
+		int32_t v, vt, vn;
+		bool operator==(const ObjCornerKey& o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+	};
+
+	struct ObjCornerHash
+	{
+		size_t operator()(const ObjCornerKey& k) const
+		{
+			// v and vt fill the first word, vn is mixed in after so no bits overlap
+			return HashMix(HashMix((uint64_t)(uint32_t)k.v | (uint64_t)(uint32_t)k.vt << 32) ^ (uint32_t)k.vn);
+		}
+	};
+
+	// split the mesh into one submesh per object/group/material range of the file.
+	// a mesh without any of those is a single unnamed submesh.
+	// materials that mesh.materials doesn't know yet are added with default values
+	void BuildSubmeshes(const std::vector<ObjMarker>& markers, Mesh& mesh)
+	{
+		std::string object, group;
+		uint32_t material = 0;
+		size_t marker = 0;
+		size_t start = 0;
+		while (start < mesh.indices.size())
+		{
+			for (; marker < markers.size() && markers[marker].corner <= start; marker++)
+			{
+				const ObjMarker& m = markers[marker];
+				if (m.type == 'o')
+				{
+					// groups don't carry over into the next object
+					object = m.name;
+					group.clear();
+				}
+				else if (m.type == 'g')
+					group = m.name;
+				else if (m.type == 'm')
+					material = FindMaterial(mesh.materials, m.name);
+			}
+			size_t end = marker < markers.size() ? std::min(markers[marker].corner, mesh.indices.size()) : mesh.indices.size();
+
+			Submesh submesh;
+			submesh.name = group.empty() ? object : object.empty() ? group : object + "/" + group;
+			submesh.material = material;
+			submesh.firstIndex = start;
+			submesh.indexCount = end - start;
+			ComputeIndexedBounds(mesh.positions.data(), 3, &mesh.indices[start], end - start, submesh.boundsMin, submesh.boundsMax);
+			mesh.submeshes.push_back(std::move(submesh));
+			start = end;
+		}
+	}
+
+	// reorder the submeshes (and their ranges of the index buffer) so that all the submeshes
+	// of a material are next to each other. a material then is one contiguous range that
+	// can be drawn with a single call, the order within a material is kept
+	void SortSubmeshesByMaterial(Mesh& mesh)
+	{
+		auto byMaterial = [](const Submesh& a, const Submesh& b) { return a.material < b.material; };
+		if (std::is_sorted(mesh.submeshes.begin(), mesh.submeshes.end(), byMaterial))
+			return;
+		std::stable_sort(mesh.submeshes.begin(), mesh.submeshes.end(), byMaterial);
+
+		std::vector<uint32_t> indices(mesh.indices.size());
+		uint32_t firstIndex = 0;
+		for (Submesh& submesh : mesh.submeshes)
+		{
+			auto src = mesh.indices.begin() + submesh.firstIndex;
+			std::copy(src, src + submesh.indexCount, indices.begin() + firstIndex);
+			submesh.firstIndex = firstIndex;
+			firstIndex += submesh.indexCount;
+		}
+		mesh.indices.swap(indices);
+	}
+
+	// turn the separately indexed obj streams into one indexed vertex buffer.
+	// every distinct (v, vt, vn) triple becomes one vertex, in order of first use
+	Mesh BuildMesh(ObjData data, std::vector<Material> materials = {})
+	{
+		Mesh mesh;
+		mesh.materials = std::move(materials);
+		if (mesh.materials.empty() || mesh.materials[0].name != "default")
+		{
+			Material material;
+			material.name = "default";
+			mesh.materials.insert(mesh.materials.begin(), material);
+		}
+		bool hasTexCoords = !data.corners[1].empty();
+		bool hasNormals = !data.corners[2].empty();
+		size_t numCorners = data.CornerCount();
+
+		// only positions, the obj indexing already is the vertex indexing
+		if (!hasTexCoords && !hasNormals)
+		{
+			mesh.positions = std::move(data.positions);
+			mesh.indices.assign(data.corners[0].begin(), data.corners[0].end());
+			BuildSubmeshes(data.markers, mesh);
+			SortSubmeshesByMaterial(mesh);
+			return mesh;
+		}
+
+		IndexMap<ObjCornerKey, ObjCornerHash> vertexMap(data.positions.size() / 3);
+		mesh.indices.resize(numCorners);
+		for (size_t i = 0; i < numCorners; i++)
+		{
+			ObjCornerKey key = {data.corners[0][i], hasTexCoords ? data.corners[1][i] : -1, hasNormals ? data.corners[2][i] : -1};
+			auto inserted = vertexMap.Insert(key, (uint32_t)vertexMap.Size());
+			mesh.indices[i] = inserted.first;
+			if (!inserted.second)
+				continue;
+
+			const float* p = &data.positions[key.v * 3];
+			mesh.positions.insert(mesh.positions.end(), p, p + 3);
+			if (hasTexCoords)
+			{
+				if (key.vt >= 0)
+					mesh.texCoords.insert(mesh.texCoords.end(), &data.texCoords[key.vt * 2], &data.texCoords[key.vt * 2] + 2);
+				else
+					mesh.texCoords.insert(mesh.texCoords.end(), 2, 0.0f);
+			}
+			if (hasNormals)
+			{
+				if (key.vn >= 0)
+					mesh.normals.insert(mesh.normals.end(), &data.normals[key.vn * 3], &data.normals[key.vn * 3] + 3);
+				else
+					mesh.normals.insert(mesh.normals.end(), 3, 0.0f);
+			}
+		}
+		BuildSubmeshes(data.markers, mesh);
+		SortSubmeshesByMaterial(mesh);
+		return mesh;
+	}
+
+	// load an obj file as an indexed mesh, see LoadObjData and BuildMesh.
+	// mtllib paths are relative to the directory of the obj
+	Mesh LoadObjMesh(const char* filename)
+	{
+		ObjData data = LoadObjData(filename);
+
+		std::vector<Material> materials;
+		std::vector<std::string> libraries;
+		std::string directory = filename;
+		size_t slash = directory.find_last_of('/');
+		directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+		for (const ObjMarker& marker : data.markers)
+		{
+			if (marker.type != 'l')
+				continue;
+			std::string path = marker.name[0] == '/' ? marker.name : directory + marker.name;
+			if (LoadMtl(path.c_str(), materials))
+				libraries.push_back(path);
+			else
+				fprintf(stderr, "Failed to load material library %s\n", path.c_str());
+		}
+		Mesh mesh = BuildMesh(std::move(data), std::move(materials));
+		mesh.materialLibraries = std::move(libraries);
+		return mesh;
+	}
+
+	// load only the positions and triangle indices of an obj file
+	std::pair<std::vector<float>, std::vector<uint32_t>> LoadObj(const char* filename)
+	{
+		ObjData data = LoadObjData(filename);
+		data.corners[1].clear();
+		data.corners[2].clear();
+		Mesh mesh = BuildMesh(std::move(data));
+		return {std::move(mesh.positions), std::move(mesh.indices)};
+	}
+}
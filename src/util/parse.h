@@ -0,0 +1,57 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <system_error>
+
+namespace Util
+{
+
+	// helpers to read numbers straight out of a text buffer. nothing is copied or
+	// terminated, and std::from_chars does not look at the locale
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	const char* SkipToken(const char* p, const char* end)
+	{
+		while (p < end && !IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	// parse a float at p and move p past it. on failure p is left where it was
+	bool ParseFloat(const char*& p, const char* end, float& out)
+	{
+		const char* start = p;
+		// from_chars doesn't accept an explicit plus sign
+		if (start < end && *start == '+')
+			++start;
+		auto result = std::from_chars(start, end, out, std::chars_format::general);
+		if (result.ec != std::errc() && result.ec != std::errc::result_out_of_range)
+			return false;
+		p = result.ptr;
+		return true;
+	}
+
+	// parse a signed integer at p and move p past it. on failure p is left where it was
+	bool ParseInt(const char*& p, const char* end, int64_t& out)
+	{
+		const char* start = p;
+		if (start < end && *start == '+')
+			++start;
+		auto result = std::from_chars(start, end, out);
+		if (result.ec != std::errc())
+			return false;
+		p = result.ptr;
+		return true;
+	}
+}
@@ -0,0 +1,456 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "mesh.h"
+#include "parse.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	enum class PlyFormat
+	{
+		Ascii,
+		BinaryLittleEndian,
+		BinaryBigEndian,
+	};
+
+	enum class PlyType
+	{
+		None,
+		Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64,
+	};
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type = PlyType::None;
+		PlyType countType = PlyType::None; // set for list properties
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+	};
+
+	PlyType ParsePlyType(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::None;
+	}
+
+	size_t PlyTypeSize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		case PlyType::Float64: return 8;
+		default: return 0;
+		}
+	}
+
+	// reads the values of a ply body one at a time, in whichever format the file uses
+	class PlyReader
+	{
+	public:
+		PlyReader(const char* p, const char* end, PlyFormat format) : m_p(p), m_end(end), m_format(format) {}
+
+		bool Read(PlyType type, double& out)
+		{
+			if (m_format == PlyFormat::Ascii)
+			{
+				while (m_p < m_end && (IsSpace(*m_p) || *m_p == '\n'))
+					++m_p;
+				float value;
+				int64_t intValue;
+				const char* start = m_p;
+				if (type == PlyType::Float32 || type == PlyType::Float64)
+				{
+					if (!ParseFloat(m_p, m_end, value))
+						return false;
+					out = value;
+				}
+				else
+				{
+					if (!ParseInt(m_p, m_end, intValue))
+						return false;
+					out = intValue;
+				}
+				return m_p != start;
+			}
+
+			size_t size = PlyTypeSize(type);
+			if ((size_t)(m_end - m_p) < size)
+				return false;
+			unsigned char bytes[8];
+			memcpy(bytes, m_p, size);
+			m_p += size;
+			if (m_format == PlyFormat::BinaryBigEndian)
+				std::reverse(bytes, bytes + size);
+
+			switch (type)
+			{
+			case PlyType::Int8: out = (int8_t)bytes[0]; break;
+			case PlyType::UInt8: out = bytes[0]; break;
+			case PlyType::Int16: { int16_t v; memcpy(&v, bytes, 2); out = v; break; }
+			case PlyType::UInt16: { uint16_t v; memcpy(&v, bytes, 2); out = v; break; }
+			case PlyType::Int32: { int32_t v; memcpy(&v, bytes, 4); out = v; break; }
+			case PlyType::UInt32: { uint32_t v; memcpy(&v, bytes, 4); out = v; break; }
+			case PlyType::Float32: { float v; memcpy(&v, bytes, 4); out = v; break; }
+			case PlyType::Float64: { double v; memcpy(&v, bytes, 8); out = v; break; }
+			default: return false;
+			}
+			return true;
+		}
+
+		const char* Position() const { return m_p; }
+		void Skip(size_t bytes) { m_p += bytes; }
+
+	private:
+		const char* m_p;
+		const char* m_end;
+		PlyFormat m_format;
+	};
+
+	bool IsPly(const char* data, size_t size)
+	{
+		return size >= 4 && memcmp(data, "ply", 3) == 0 && (data[3] == '\n' || data[3] == '\r');
+	}
+
+	// parse the header up to and including "end_header", body points at the data after it
+	bool ParsePlyHeader(const char* data, size_t size, PlyFormat& format, std::vector<PlyElement>& elements, const char*& body)
+	{
+		const char* end = data + size;
+		const char* p = data;
+		bool hasFormat = false;
+		while (p < end)
+		{
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if (!lineEnd)
+				return false;
+			const char* next = lineEnd + 1;
+
+			std::vector<std::string> words;
+			for (const char* w = SkipSpaces(p, lineEnd); w < lineEnd; w = SkipSpaces(w, lineEnd))
+			{
+				const char* wordEnd = SkipToken(w, lineEnd);
+				words.emplace_back(w, wordEnd);
+				w = wordEnd;
+			}
+			p = next;
+			if (words.empty())
+				continue;
+
+			if (words[0] == "end_header")
+			{
+				body = p;
+				return hasFormat;
+			}
+			else if (words[0] == "format" && words.size() >= 2)
+			{
+				hasFormat = true;
+				if (words[1] == "ascii")
+					format = PlyFormat::Ascii;
+				else if (words[1] == "binary_little_endian")
+					format = PlyFormat::BinaryLittleEndian;
+				else if (words[1] == "binary_big_endian")
+					format = PlyFormat::BinaryBigEndian;
+				else
+					return false;
+			}
+			else if (words[0] == "element" && words.size() >= 3)
+			{
+				PlyElement element;
+				element.name = words[1];
+				element.count = strtoull(words[2].c_str(), nullptr, 10);
+				elements.push_back(element);
+			}
+			else if (words[0] == "property" && !elements.empty())
+			{
+				PlyProperty property;
+				if (words.size() >= 5 && words[1] == "list")
+				{
+					property.countType = ParsePlyType(words[2]);
+					property.type = ParsePlyType(words[3]);
+					property.name = words[4];
+				}
+				else if (words.size() >= 3)
+				{
+					property.type = ParsePlyType(words[1]);
+					property.name = words[2];
+				}
+				if (property.type == PlyType::None)
+					return false;
+				elements.back().properties.push_back(property);
+			}
+		}
+		return false;
+	}
+
+	// the size of one entry of an element, 0 when it has list properties
+	size_t PlyElementStride(const PlyElement& element)
+	{
+		size_t stride = 0;
+		for (const PlyProperty& property : element.properties)
+		{
+			if (property.countType != PlyType::None)
+				return 0;
+			stride += PlyTypeSize(property.type);
+		}
+		return stride;
+	}
+
+	// whether element's entries can all be in the bytes left, checked before allocating for them
+	// so a corrupt count fails instead of asking for more memory than the file could fill.
+	// every list is at least its count and every ascii value at least a character
+	bool PlyElementFits(const PlyElement& element, PlyFormat format, size_t bytesLeft)
+	{
+		size_t minSize = 0;
+		for (const PlyProperty& property : element.properties)
+			minSize += format == PlyFormat::Ascii ? 1 : PlyTypeSize(property.countType != PlyType::None ? property.countType : property.type);
+		return minSize ? element.count <= bytesLeft / minSize : element.count == 0;
+	}
+
+	// read a vertex element. the common float x, y, z (little endian) layout is copied as is,
+	// other fixed size binary layouts are decoded in parallel since every vertex is stride bytes
+	bool ReadPlyVertices(const PlyElement& element, PlyFormat format, PlyReader& reader, const char* end, Mesh& mesh)
+	{
+		// which attribute each property feeds, -1 for none
+		std::vector<int> targets;
+		bool hasNormals = false, hasTexCoords = false;
+		const char* names[] = {"x", "y", "z", "nx", "ny", "nz", "u", "v", "s", "t", "texture_u", "texture_v"};
+		for (const PlyProperty& property : element.properties)
+		{
+			int target = -1;
+			for (int i = 0; i < 12; i++)
+			{
+				if (property.name == names[i] && property.countType == PlyType::None)
+					target = i;
+			}
+			// s/t and texture_u/v are other names for u/v
+			if (target >= 8)
+				target = 6 + (target - 8) % 2;
+			hasNormals |= target >= 3 && target < 6;
+			hasTexCoords |= target >= 6;
+			targets.push_back(target);
+		}
+
+		if (!PlyElementFits(element, format, end - reader.Position()))
+			return false;
+		size_t count = element.count;
+		mesh.positions.resize(count * 3);
+		if (hasNormals)
+			mesh.normals.resize(count * 3);
+		if (hasTexCoords)
+			mesh.texCoords.resize(count * 2);
+
+		size_t stride = PlyElementStride(element);
+		if (format != PlyFormat::Ascii && stride)
+		{
+			if ((size_t)(end - reader.Position()) < count * stride)
+				return false;
+			const char* data = reader.Position();
+			reader.Skip(count * stride);
+
+			bool plain = format == PlyFormat::BinaryLittleEndian && element.properties.size() == 3 && targets[0] == 0 && targets[1] == 1 && targets[2] == 2
+				&& element.properties[0].type == PlyType::Float32 && element.properties[1].type == PlyType::Float32 && element.properties[2].type == PlyType::Float32;
+			if (plain)
+			{
+				memcpy(mesh.positions.data(), data, count * 12);
+				return true;
+			}
+
+			const size_t blockSize = 1 << 14;
+			GetThreadPool().ParallelFor((count + blockSize - 1) / blockSize, [&](size_t block)
+			{
+				size_t first = block * blockSize;
+				size_t last = std::min(count, first + blockSize);
+				PlyReader blockReader(data + first * stride, data + last * stride, format);
+				for (size_t i = first; i < last; i++)
+				{
+					for (size_t j = 0; j < element.properties.size(); j++)
+					{
+						double value = 0;
+						blockReader.Read(element.properties[j].type, value);
+						int target = targets[j];
+						if (target >= 0 && target < 3)
+							mesh.positions[i * 3 + target] = value;
+						else if (target >= 3 && target < 6)
+							mesh.normals[i * 3 + target - 3] = value;
+						else if (target >= 6)
+							mesh.texCoords[i * 2 + target - 6] = value;
+					}
+				}
+			});
+			return true;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t j = 0; j < element.properties.size(); j++)
+			{
+				const PlyProperty& property = element.properties[j];
+				double value = 0;
+				size_t numValues = 1;
+				if (property.countType != PlyType::None)
+				{
+					if (!reader.Read(property.countType, value))
+						return false;
+					numValues = value;
+				}
+				for (size_t k = 0; k < numValues; k++)
+				{
+					if (!reader.Read(property.type, value))
+						return false;
+				}
+				int target = targets[j];
+				if (target >= 0 && target < 3)
+					mesh.positions[i * 3 + target] = value;
+				else if (target >= 3 && target < 6)
+					mesh.normals[i * 3 + target - 3] = value;
+				else if (target >= 6)
+					mesh.texCoords[i * 2 + target - 6] = value;
+			}
+		}
+		return true;
+	}
+
+	// read a face element, polygons are fan triangulated and ones with invalid indices dropped
+	bool ReadPlyFaces(const PlyElement& element, PlyFormat format, PlyReader& reader, const char* end, Mesh& mesh)
+	{
+		size_t numVertices = mesh.positions.size() / 3;
+
+		// what nearly every binary ply has, "property list uchar int vertex_indices" and nothing else
+		if (format == PlyFormat::BinaryLittleEndian && element.properties.size() == 1 && element.properties[0].countType == PlyType::UInt8
+			&& (element.properties[0].type == PlyType::Int32 || element.properties[0].type == PlyType::UInt32)
+			&& (element.properties[0].name == "vertex_indices" || element.properties[0].name == "vertex_index"))
+		{
+			const char* p = reader.Position();
+			if (!PlyElementFits(element, format, end - p))
+				return false;
+			// only a face of 3 or more corners, 13 bytes at least, adds indices
+			mesh.indices.reserve(mesh.indices.size() + std::min<size_t>(element.count, (end - p) / 13) * 3);
+			for (size_t i = 0; i < element.count; i++)
+			{
+				if (p >= end)
+					return false;
+				size_t numCorners = (unsigned char)*p++;
+				if ((size_t)(end - p) < numCorners * 4)
+					return false;
+				uint32_t polygon[256];
+				memcpy(polygon, p, numCorners * 4);
+				p += numCorners * 4;
+
+				bool valid = true;
+				for (size_t k = 0; k < numCorners; k++)
+					valid &= polygon[k] < numVertices;
+				for (size_t k = 1; valid && k + 1 < numCorners; k++)
+				{
+					mesh.indices.push_back(polygon[0]);
+					mesh.indices.push_back(polygon[k]);
+					mesh.indices.push_back(polygon[k + 1]);
+				}
+			}
+			reader.Skip(p - reader.Position());
+			return true;
+		}
+
+		std::vector<uint32_t> polygon;
+		for (size_t i = 0; i < element.count; i++)
+		{
+			for (const PlyProperty& property : element.properties)
+			{
+				double value = 0;
+				size_t numValues = 1;
+				if (property.countType != PlyType::None)
+				{
+					if (!reader.Read(property.countType, value))
+						return false;
+					numValues = value;
+				}
+
+				bool isIndices = property.countType != PlyType::None && (property.name == "vertex_indices" || property.name == "vertex_index");
+				polygon.clear();
+				bool valid = true;
+				for (size_t k = 0; k < numValues; k++)
+				{
+					if (!reader.Read(property.type, value))
+						return false;
+					if (!isIndices)
+						continue;
+					valid &= value >= 0 && value < numVertices;
+					polygon.push_back(value);
+				}
+				if (!isIndices || !valid)
+					continue;
+				for (size_t k = 1; k + 1 < polygon.size(); k++)
+				{
+					mesh.indices.push_back(polygon[0]);
+					mesh.indices.push_back(polygon[k]);
+					mesh.indices.push_back(polygon[k + 1]);
+				}
+			}
+		}
+		return true;
+	}
+
+	// ascii, binary little or big endian ply. vertex and face elements are read, anything
+	// else is skipped
+	Mesh ParsePly(const char* data, size_t size)
+	{
+		Mesh mesh;
+		PlyFormat format = PlyFormat::Ascii;
+		std::vector<PlyElement> elements;
+		const char* body;
+		if (!ParsePlyHeader(data, size, format, elements, body))
+			return mesh;
+
+		const char* end = data + size;
+		PlyReader reader(body, end, format);
+		for (const PlyElement& element : elements)
+		{
+			bool ok;
+			if (element.name == "vertex")
+				ok = ReadPlyVertices(element, format, reader, end, mesh);
+			else if (element.name == "face")
+				ok = ReadPlyFaces(element, format, reader, end, mesh);
+			else
+			{
+				// skip it, reading it as faces without the index property does exactly that
+				PlyElement skipped = element;
+				for (PlyProperty& property : skipped.properties)
+					property.name.clear();
+				ok = ReadPlyFaces(skipped, format, reader, end, mesh);
+			}
+			if (!ok)
+				return Mesh();
+		}
+		return mesh;
+	}
+
+	Mesh LoadPly(const char* filename)
+	{
+		MappedFile file;
+		if (!file.Open(filename))
+			return Mesh();
+		Mesh mesh = ParsePly(file.Data(), file.Size());
+		SetSingleSubmesh(mesh);
+		return mesh;
+	}
+}
@@ -0,0 +1,292 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Util
+{
+
+	// the gl type of a uniform that is set from a T
+	template<typename T> struct UniformType;
+	template<> struct UniformType<float> { static constexpr uint32_t glType = GL_FLOAT; };
+	template<> struct UniformType<int32_t> { static constexpr uint32_t glType = GL_INT; };
+	template<> struct UniformType<uint32_t> { static constexpr uint32_t glType = GL_UNSIGNED_INT; };
+	template<> struct UniformType<glm::vec2> { static constexpr uint32_t glType = GL_FLOAT_VEC2; };
+	template<> struct UniformType<glm::vec3> { static constexpr uint32_t glType = GL_FLOAT_VEC3; };
+	template<> struct UniformType<glm::vec4> { static constexpr uint32_t glType = GL_FLOAT_VEC4; };
+	template<> struct UniformType<glm::ivec2> { static constexpr uint32_t glType = GL_INT_VEC2; };
+	template<> struct UniformType<glm::ivec3> { static constexpr uint32_t glType = GL_INT_VEC3; };
+	template<> struct UniformType<glm::ivec4> { static constexpr uint32_t glType = GL_INT_VEC4; };
+	template<> struct UniformType<glm::uvec2> { static constexpr uint32_t glType = GL_UNSIGNED_INT_VEC2; };
+	template<> struct UniformType<glm::uvec3> { static constexpr uint32_t glType = GL_UNSIGNED_INT_VEC3; };
+	template<> struct UniformType<glm::uvec4> { static constexpr uint32_t glType = GL_UNSIGNED_INT_VEC4; };
+	template<> struct UniformType<glm::mat3> { static constexpr uint32_t glType = GL_FLOAT_MAT3; };
+	template<> struct UniformType<glm::mat4> { static constexpr uint32_t glType = GL_FLOAT_MAT4; };
+
+	// a uniform of one ShaderProgram. a program that doesn't have it gives an invalid handle,
+	// setting that does nothing
+	template<typename T>
+	struct Uniform
+	{
+		int32_t index = -1;
+		bool IsValid() const { return index >= 0; }
+	};
+
+	// a linked program with its active uniforms looked up once. values are kept on the cpu and
+	// only the ones that changed are sent to gl when it is used, uniforms keep their values
+	// between uses of a program so that's all it needs
+	class ShaderProgram
+	{
+	public:
+		ShaderProgram() = default;
+		ShaderProgram(const ShaderProgram&) = delete;
+		ShaderProgram& operator=(const ShaderProgram&) = delete;
+		ShaderProgram(ShaderProgram&& other) { *this = std::move(other); }
+		ShaderProgram& operator=(ShaderProgram&& other)
+		{
+			std::swap(m_iProgram, other.m_iProgram);
+			std::swap(m_uniforms, other.m_uniforms);
+			std::swap(m_values, other.m_values);
+			std::swap(m_bDirty, other.m_bDirty);
+			return *this;
+		}
+		~ShaderProgram() { Destroy(); }
+
+		// compile and link the two stages. the errors are printed, false when it didn't link,
+		// the program created before is kept then
+		bool Create(const char* vss, const char* fss)
+		{
+			uint32_t vs = Compile(GL_VERTEX_SHADER, vss, "Vertex");
+			uint32_t fs = Compile(GL_FRAGMENT_SHADER, fss, "Fragment");
+			uint32_t program = glCreateProgram();
+			glAttachShader(program, vs);
+			glAttachShader(program, fs);
+			glLinkProgram(program);
+			glDeleteShader(vs);
+			glDeleteShader(fs);
+
+			int status;
+			glGetProgramiv(program, GL_LINK_STATUS, &status);
+			if (!status)
+			{
+				char infoLog[512];
+				glGetProgramInfoLog(program, sizeof(infoLog), nullptr, infoLog);
+				printf("Failed to link program\n%s\n", infoLog);
+				glDeleteProgram(program);
+				return false;
+			}
+			Destroy();
+			m_iProgram = program;
+			Reflect();
+			return true;
+		}
+
+		void Destroy()
+		{
+			if (m_iProgram)
+				glDeleteProgram(m_iProgram);
+			m_iProgram = 0;
+			m_uniforms.clear();
+			m_values.clear();
+			m_bDirty = false;
+		}
+
+		uint32_t Id() const { return m_iProgram; }
+
+		// the handle of the uniform called name, invalid when the program doesn't use it or
+		// it isn't a T. arrays are found by their name without [0], bools are set with int32_t
+		// or ivec and samplers with the int32_t of their texture unit
+		template<typename T>
+		Uniform<T> Find(const char* name) const
+		{
+			Uniform<T> uniform;
+			for (size_t i = 0; i < m_uniforms.size(); i++)
+			{
+				if (m_uniforms[i].name != name)
+					continue;
+				if (SetType(m_uniforms[i].type) != UniformType<T>::glType)
+					printf("Uniform %s doesn't have the type it is set with\n", name);
+				else
+					uniform.index = i;
+				break;
+			}
+			return uniform;
+		}
+
+		// count elements of an array starting at value, the first ones if the array is shorter
+		template<typename T>
+		void Set(Uniform<T> uniform, const T* value, size_t count = 1)
+		{
+			if (!uniform.IsValid())
+				return;
+			UniformInfo& info = m_uniforms[uniform.index];
+			size_t bytes = std::min<size_t>(count, info.count) * sizeof(T);
+			char* current = &m_values[info.offset];
+			if (memcmp(current, value, bytes) == 0)
+				return;
+			memcpy(current, value, bytes);
+			info.dirty = true;
+			m_bDirty = true;
+		}
+
+		template<typename T>
+		void Set(Uniform<T> uniform, const T& value) { Set(uniform, &value); }
+
+		// read the uniform block called name from binding, false when the program doesn't have it
+		bool BindBlock(const char* name, uint32_t binding)
+		{
+			uint32_t block = glGetUniformBlockIndex(m_iProgram, name);
+			if (block == GL_INVALID_INDEX)
+				return false;
+			glUniformBlockBinding(m_iProgram, block, binding);
+			return true;
+		}
+
+		// bind the program, the uniforms are sent by Flush
+		void Use() const { glUseProgram(m_iProgram); }
+
+		// send the uniforms that changed since the last flush, the program has to be in use.
+		// call it before every draw, it costs nothing when nothing changed
+		void Flush()
+		{
+			if (!m_bDirty)
+				return;
+			for (UniformInfo& info : m_uniforms)
+			{
+				if (!info.dirty)
+					continue;
+				const void* value = &m_values[info.offset];
+				switch (SetType(info.type))
+				{
+				case GL_FLOAT: glUniform1fv(info.location, info.count, (const float*)value); break;
+				case GL_FLOAT_VEC2: glUniform2fv(info.location, info.count, (const float*)value); break;
+				case GL_FLOAT_VEC3: glUniform3fv(info.location, info.count, (const float*)value); break;
+				case GL_FLOAT_VEC4: glUniform4fv(info.location, info.count, (const float*)value); break;
+				case GL_FLOAT_MAT3: glUniformMatrix3fv(info.location, info.count, GL_FALSE, (const float*)value); break;
+				case GL_FLOAT_MAT4: glUniformMatrix4fv(info.location, info.count, GL_FALSE, (const float*)value); break;
+				case GL_INT: glUniform1iv(info.location, info.count, (const int32_t*)value); break;
+				case GL_INT_VEC2: glUniform2iv(info.location, info.count, (const int32_t*)value); break;
+				case GL_INT_VEC3: glUniform3iv(info.location, info.count, (const int32_t*)value); break;
+				case GL_INT_VEC4: glUniform4iv(info.location, info.count, (const int32_t*)value); break;
+				case GL_UNSIGNED_INT: glUniform1uiv(info.location, info.count, (const uint32_t*)value); break;
+				case GL_UNSIGNED_INT_VEC2: glUniform2uiv(info.location, info.count, (const uint32_t*)value); break;
+				case GL_UNSIGNED_INT_VEC3: glUniform3uiv(info.location, info.count, (const uint32_t*)value); break;
+				case GL_UNSIGNED_INT_VEC4: glUniform4uiv(info.location, info.count, (const uint32_t*)value); break;
+				}
+				info.dirty = false;
+			}
+			m_bDirty = false;
+		}
+
+	private:
+		struct UniformInfo
+		{
+			std::string name;
+			int32_t location;
+			uint32_t type;
+			int32_t count; // array elements
+			size_t offset; // into m_values
+			bool dirty;
+		};
+
+		static uint32_t Compile(uint32_t stage, const char* source, const char* name)
+		{
+			uint32_t shader = glCreateShader(stage);
+			glShaderSource(shader, 1, &source, nullptr);
+			glCompileShader(shader);
+			int status;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+			if (!status)
+			{
+				char infoLog[512];
+				glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
+				printf("%s shader failed to compile!\n%s\n", name, infoLog);
+			}
+			return shader;
+		}
+
+		// the type a uniform's value is kept and sent as, bools and samplers go through ints.
+		// 0 for the ones there is no T for
+		static uint32_t SetType(uint32_t type)
+		{
+			switch (type)
+			{
+			case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+			case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+			case GL_INT: case GL_INT_VEC2: case GL_INT_VEC3: case GL_INT_VEC4:
+			case GL_UNSIGNED_INT: case GL_UNSIGNED_INT_VEC2: case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+				return type;
+			case GL_BOOL: return GL_INT;
+			case GL_BOOL_VEC2: return GL_INT_VEC2;
+			case GL_BOOL_VEC3: return GL_INT_VEC3;
+			case GL_BOOL_VEC4: return GL_INT_VEC4;
+			case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+			case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_ARRAY_SHADOW:
+			case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+				return GL_INT;
+			default: return 0;
+			}
+		}
+
+		static size_t TypeSize(uint32_t type)
+		{
+			switch (SetType(type))
+			{
+			case GL_FLOAT: return sizeof(float);
+			case GL_FLOAT_VEC2: return sizeof(glm::vec2);
+			case GL_FLOAT_VEC3: return sizeof(glm::vec3);
+			case GL_FLOAT_VEC4: return sizeof(glm::vec4);
+			case GL_FLOAT_MAT3: return sizeof(glm::mat3);
+			case GL_FLOAT_MAT4: return sizeof(glm::mat4);
+			case GL_INT: case GL_UNSIGNED_INT: return sizeof(int32_t);
+			case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: return sizeof(glm::ivec2);
+			case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: return sizeof(glm::ivec3);
+			case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: return sizeof(glm::ivec4);
+			default: return 0;
+			}
+		}
+
+		// every active uniform outside of a block, with zeroes as its value like gl starts it with.
+		// the types there is no T for are left out, setting them isn't possible
+		void Reflect()
+		{
+			int numUniforms = 0;
+			glGetProgramiv(m_iProgram, GL_ACTIVE_UNIFORMS, &numUniforms);
+			size_t offset = 0;
+			for (int i = 0; i < numUniforms; i++)
+			{
+				char name[256];
+				int length = 0;
+				UniformInfo info;
+				glGetActiveUniform(m_iProgram, i, sizeof(name), &length, &info.count, &info.type, name);
+				info.location = glGetUniformLocation(m_iProgram, name);
+				if (info.location < 0)
+					continue;
+				if (!SetType(info.type))
+				{
+					printf("Uniform %s has a type that can't be set\n", name);
+					continue;
+				}
+				info.name.assign(name, length);
+				if (info.name.size() > 3 && info.name.compare(info.name.size() - 3, 3, "[0]") == 0)
+					info.name.resize(info.name.size() - 3);
+				info.offset = offset;
+				info.dirty = false;
+				offset += TypeSize(info.type) * info.count;
+				m_uniforms.push_back(info);
+			}
+			m_values.assign(offset, 0);
+		}
+
+		uint32_t m_iProgram = 0;
+		std::vector<UniformInfo> m_uniforms;
+		std::vector<char> m_values;
+		bool m_bDirty = false;
+	};
+}
@@ -0,0 +1,350 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "half_edge.h"
+#include "mesh.h"
+#include "thread_pool.h"
+#include "vertex_cache.h"
+
+namespace Util
+{
+
+	// every lod aims for half the triangles of the one before
+	constexpr uint32_t LOD_MAX_LEVELS = 4;
+	// no collapse may move the surface by more than this fraction of the mesh size
+	constexpr float LOD_MAX_ERROR = 0.05f;
+	// a level that can't get below this fraction of the previous one ends the chain
+	constexpr float LOD_MIN_REDUCTION = 0.8f;
+
+	// the squared distance to a set of planes (Garland and Heckbert, "Surface simplification
+	// using quadric error metrics"), kept as the upper half of the symmetric 4x4 matrix
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0;
+		double b2 = 0, bc = 0, bd = 0;
+		double c2 = 0, cd = 0;
+		double d2 = 0;
+
+		void AddPlane(double a, double b, double c, double d)
+		{
+			a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+			b2 += b * b; bc += b * c; bd += b * d;
+			c2 += c * c; cd += c * d;
+			d2 += d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+		}
+
+		double Evaluate(const float* p) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z
+				+ d2;
+			return e > 0 ? e : 0;
+		}
+	};
+
+	// collapse edges of the triangles in indices until there are at most targetIndexCount
+	// indices left or the next collapse would move the surface further than maxError.
+	// vertices only ever collapse onto other vertices, so the vertex buffer (positions the first
+	// 3 floats of every stride) is shared with the result. vertices on borders and seams stay.
+	// returns how far the surface may have moved, in the units of the positions
+	float SimplifyIndices(const float* vertices, size_t stride, std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError)
+	{
+		std::vector<uint32_t> local;
+		std::vector<uint32_t> global;
+		CompactIndices(indices.data(), indices.size() / 3 * 3, local, global);
+		size_t numVertices = global.size();
+
+		std::vector<float> positions(numVertices * 3);
+		for (size_t v = 0; v < numVertices; v++)
+			std::copy(vertices + global[v] * stride, vertices + global[v] * stride + 3, &positions[v * 3]);
+		auto position = [&](uint32_t v) { return &positions[v * 3]; };
+
+		// seams are copies of a vertex at the same place (different normals or uvs), they
+		// would tear apart if only one of them moved
+		std::vector<bool> locked(numVertices, false);
+		{
+			std::vector<uint32_t> order(numVertices);
+			for (uint32_t v = 0; v < numVertices; v++)
+				order[v] = v;
+			auto less = [&](uint32_t a, uint32_t b) { return std::lexicographical_compare(position(a), position(a) + 3, position(b), position(b) + 3); };
+			std::sort(order.begin(), order.end(), less);
+			for (size_t i = 1; i < numVertices; i++)
+			{
+				if (!less(order[i - 1], order[i]))
+					locked[order[i - 1]] = locked[order[i]] = true;
+			}
+		}
+
+		// vertices on borders and non manifold vertices are kept
+		{
+			HalfEdgeMesh topology;
+			topology.Build(local.data(), local.size(), numVertices);
+			for (uint32_t v = 0; v < numVertices; v++)
+			{
+				if (topology.IsBoundaryVertex(v) || !topology.IsManifoldVertex(v))
+					locked[v] = true;
+			}
+		}
+
+		std::vector<Quadric> quadrics(numVertices);
+		for (size_t t = 0; t < local.size() / 3; t++)
+		{
+			const float* p0 = position(local[t * 3]);
+			const float* p1 = position(local[t * 3 + 1]);
+			const float* p2 = position(local[t * 3 + 2]);
+			double a[3] = {(double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2]};
+			double b[3] = {(double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2]};
+			double n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+			double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length <= 0)
+				continue;
+			for (double& c : n)
+				c /= length;
+			double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+			for (int k = 0; k < 3; k++)
+				quadrics[local[t * 3 + k]].AddPlane(n[0], n[1], n[2], d);
+		}
+
+		struct Collapse
+		{
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> adjacency;
+		std::vector<uint32_t> remap(numVertices);
+		std::vector<bool> touched(numVertices);
+		double maxCost = (double)maxError * maxError;
+		double worst = 0;
+
+		// each pass collapses a batch of the cheapest edges that don't share any triangles,
+		// then the indices are rewritten and the degenerate triangles dropped
+		while (local.size() > targetIndexCount)
+		{
+			size_t numTriangles = local.size() / 3;
+			offsets.assign(numVertices + 1, 0);
+			for (uint32_t v : local)
+				offsets[v + 1]++;
+			for (size_t v = 0; v < numVertices; v++)
+				offsets[v + 1] += offsets[v];
+			adjacency.resize(local.size());
+			{
+				std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < local.size(); i++)
+					adjacency[cursor[local[i]]++] = i / 3;
+			}
+
+			collapses.clear();
+			for (size_t t = 0; t < numTriangles; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = local[t * 3 + k];
+					uint32_t b = local[t * 3 + (k + 1) % 3];
+					// every inner edge shows up twice, once in each direction
+					if (a > b)
+						continue;
+					Quadric q = quadrics[a];
+					q.Add(quadrics[b]);
+					double toB = locked[a] ? INFINITY : q.Evaluate(position(b));
+					double toA = locked[b] ? INFINITY : q.Evaluate(position(a));
+					if (toB <= toA && toB <= maxCost)
+						collapses.push_back({a, b, toB});
+					else if (toA < toB && toA <= maxCost)
+						collapses.push_back({b, a, toA});
+				}
+			}
+			if (collapses.empty())
+				break;
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			for (uint32_t v = 0; v < numVertices; v++)
+				remap[v] = v;
+			std::fill(touched.begin(), touched.end(), false);
+			size_t remaining = numTriangles;
+			size_t target = targetIndexCount / 3;
+			size_t done = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (remaining <= target)
+					break;
+				if (touched[collapse.from] || touched[collapse.to])
+					continue;
+
+				// moving from onto to must not turn any of the triangles that stay around
+				bool flips = false;
+				size_t removed = 0;
+				for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1] && !flips; a++)
+				{
+					const uint32_t* tri = &local[adjacency[a] * 3];
+					if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+					{
+						removed++;
+						continue;
+					}
+					const float* p[3];
+					const float* moved[3];
+					for (int k = 0; k < 3; k++)
+					{
+						p[k] = position(tri[k]);
+						moved[k] = tri[k] == collapse.from ? position(collapse.to) : p[k];
+					}
+					float n0[3], n1[3];
+					for (int i = 0; i < 2; i++)
+					{
+						const float** q = i == 0 ? p : moved;
+						float e1[3] = {q[1][0] - q[0][0], q[1][1] - q[0][1], q[1][2] - q[0][2]};
+						float e2[3] = {q[2][0] - q[0][0], q[2][1] - q[0][1], q[2][2] - q[0][2]};
+						float* n = i == 0 ? n0 : n1;
+						n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+						n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+						n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+					}
+					flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0;
+				}
+				if (flips)
+					continue;
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				worst = std::max(worst, collapse.cost);
+				remaining -= removed;
+				done++;
+
+				// nothing else around here this pass, the flip checks above would be stale
+				for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; a++)
+				{
+					for (int k = 0; k < 3; k++)
+						touched[local[adjacency[a] * 3 + k]] = true;
+				}
+			}
+			if (done == 0)
+				break;
+
+			size_t out = 0;
+			for (size_t t = 0; t < numTriangles; t++)
+			{
+				uint32_t a = remap[local[t * 3]];
+				uint32_t b = remap[local[t * 3 + 1]];
+				uint32_t c = remap[local[t * 3 + 2]];
+				if (a == b || b == c || a == c)
+					continue;
+				local[out++] = a;
+				local[out++] = b;
+				local[out++] = c;
+			}
+			local.resize(out);
+		}
+
+		indices.resize(local.size());
+		for (size_t i = 0; i < local.size(); i++)
+			indices[i] = global[local[i]];
+		return (float)std::sqrt(worst);
+	}
+
+	// one level of detail of a submesh, indices into the lod index buffer
+	struct LodRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float error; // how far the surface may be from the full mesh
+	};
+
+	// progressively simplified copies of every submesh, each level about half of the one
+	// before. ranges holds (levels - 1) * submeshes entries, level 1 first; level 0 is the
+	// mesh itself. returns the number of levels including level 0
+	uint32_t BuildLodChain(const std::vector<float>& vertices, size_t stride, const std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes,
+		std::vector<uint32_t>& lodIndices, std::vector<LodRange>& ranges)
+	{
+		lodIndices.clear();
+		ranges.clear();
+		size_t numVertices = vertices.size() / stride;
+		if (submeshes.empty() || numVertices == 0)
+			return 1;
+
+		float boundsMin[3];
+		float boundsMax[3];
+		ComputeBounds(vertices.data(), numVertices, stride, boundsMin, boundsMax);
+		float extent = std::max({boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]});
+		float maxError = extent * LOD_MAX_ERROR;
+
+		// levels[level][submesh]
+		std::vector<std::vector<std::vector<uint32_t>>> levels;
+		std::vector<std::vector<float>> errors;
+		std::vector<std::vector<uint32_t>> previous(submeshes.size());
+		for (size_t i = 0; i < submeshes.size(); i++)
+			previous[i].assign(indices.begin() + submeshes[i].firstIndex, indices.begin() + submeshes[i].firstIndex + submeshes[i].indexCount);
+		std::vector<float> previousErrors(submeshes.size(), 0.0f);
+
+		for (uint32_t level = 1; level < LOD_MAX_LEVELS; level++)
+		{
+			std::vector<std::vector<uint32_t>> current(previous);
+			std::vector<float> currentErrors(submeshes.size());
+			GetThreadPool().ParallelFor(submeshes.size(), [&](size_t i)
+			{
+				size_t target = previous[i].size() / 6 * 3;
+				float error = SimplifyIndices(vertices.data(), stride, current[i], target, maxError);
+				std::vector<uint32_t> local;
+				std::vector<uint32_t> global;
+				std::vector<uint32_t> clusters;
+				CompactIndices(current[i].data(), current[i].size(), local, global);
+				OptimizeVertexCache(local.data(), local.size(), global.size(), clusters);
+				for (size_t k = 0; k < local.size(); k++)
+					current[i][k] = global[local[k]];
+				// errors add up since every level is simplified from the one before
+				currentErrors[i] = previousErrors[i] + error;
+			});
+
+			size_t before = 0;
+			size_t after = 0;
+			for (size_t i = 0; i < submeshes.size(); i++)
+			{
+				before += previous[i].size();
+				after += current[i].size();
+			}
+			if (after > before * LOD_MIN_REDUCTION)
+				break;
+			levels.push_back(current);
+			errors.push_back(currentErrors);
+			previous = std::move(current);
+			previousErrors = std::move(currentErrors);
+		}
+
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			for (size_t i = 0; i < submeshes.size(); i++)
+			{
+				ranges.push_back({(uint32_t)lodIndices.size(), (uint32_t)levels[level][i].size(), errors[level][i]});
+				lodIndices.insert(lodIndices.end(), levels[level][i].begin(), levels[level][i].end());
+			}
+		}
+		return levels.size() + 1;
+	}
+
+	// the coarsest level whose error covers less than threshold pixels. errors has one entry per
+	// level, pixelsPerUnit is how big one unit of error is on screen. it only moves away from
+	// current once past the threshold by the hysteresis fraction, so it doesn't flicker at the edge
+	uint32_t SelectLod(const float* errors, uint32_t numLevels, float pixelsPerUnit, uint32_t current, float threshold, float hysteresis)
+	{
+		uint32_t lod = std::min(current, numLevels - 1);
+		while (lod + 1 < numLevels && errors[lod + 1] * pixelsPerUnit < threshold * (1 - hysteresis))
+			lod++;
+		while (lod > 0 && errors[lod] * pixelsPerUnit > threshold * (1 + hysteresis))
+			lod--;
+		return lod;
+	}
+}
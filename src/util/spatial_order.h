@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	constexpr size_t RADIX_SORT_BLOCK = 1 << 16;
+
+	// spread the low 10 bits of x out to every third bit
+	uint32_t SpreadBits(uint32_t x)
+	{
+		x &= 0x3ff;
+		x = (x | (x << 16)) & 0x030000ff;
+		x = (x | (x << 8)) & 0x0300f00f;
+		x = (x | (x << 4)) & 0x030c30c3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	// 30 bit morton code of p on a 1024^3 grid over the box at min, scale is 1023 / its size
+	uint32_t MortonCode(const float* p, const float min[3], const float scale[3])
+	{
+		uint32_t cell[3];
+		for (int c = 0; c < 3; c++)
+		{
+			float x = (p[c] - min[c]) * scale[c];
+			cell[c] = x > 0 ? (x < 1023 ? (uint32_t)x : 1023) : 0;
+		}
+		return SpreadBits(cell[0]) << 2 | SpreadBits(cell[1]) << 1 | SpreadBits(cell[2]);
+	}
+
+	// stable lsd radix sort of values by keys, 8 bits a pass over the low keyBits of the keys.
+	// every block counts its digits, then scatters to where the blocks before it left off
+	void RadixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t keyBits)
+	{
+		size_t count = keys.size();
+		size_t numBlocks = (count + RADIX_SORT_BLOCK - 1) / RADIX_SORT_BLOCK;
+		std::vector<uint32_t> counts(numBlocks * 256);
+		std::vector<uint32_t> keysOut(count);
+		std::vector<uint32_t> valuesOut(count);
+		for (uint32_t shift = 0; shift < keyBits; shift += 8)
+		{
+			ParallelBlocks(count, RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+			{
+				uint32_t* blockCounts = &counts[begin / RADIX_SORT_BLOCK * 256];
+				std::fill(blockCounts, blockCounts + 256, 0);
+				for (size_t i = begin; i < end; i++)
+					blockCounts[(keys[i] >> shift) & 0xff]++;
+			});
+
+			// a digit every key shares wouldn't move anything
+			bool skip = false;
+			uint32_t offset = 0;
+			for (size_t digit = 0; digit < 256; digit++)
+			{
+				uint32_t first = offset;
+				for (size_t block = 0; block < numBlocks; block++)
+				{
+					uint32_t n = counts[block * 256 + digit];
+					counts[block * 256 + digit] = offset;
+					offset += n;
+				}
+				skip = skip || offset - first == count;
+			}
+			if (skip)
+				continue;
+
+			ParallelBlocks(count, RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+			{
+				uint32_t* cursor = &counts[begin / RADIX_SORT_BLOCK * 256];
+				for (size_t i = begin; i < end; i++)
+				{
+					uint32_t to = cursor[(keys[i] >> shift) & 0xff]++;
+					keysOut[to] = keys[i];
+					valuesOut[to] = values[i];
+				}
+			});
+			keys.swap(keysOut);
+			values.swap(valuesOut);
+		}
+	}
+
+	// sort the triangles in indices by the morton code of their centroid, so triangles that are
+	// close in space are close in memory. positions are the first 3 floats of every stride
+	void SortTrianglesMorton(const float* vertices, size_t stride, uint32_t* indices, size_t numIndices)
+	{
+		size_t numTriangles = numIndices / 3;
+		if (numTriangles < 2)
+			return;
+
+		// the grid only has to cover the centroids
+		std::vector<float> centroids(numTriangles * 3);
+		ParallelBlocks(numTriangles, RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				const float* p0 = vertices + indices[t * 3] * stride;
+				const float* p1 = vertices + indices[t * 3 + 1] * stride;
+				const float* p2 = vertices + indices[t * 3 + 2] * stride;
+				for (int c = 0; c < 3; c++)
+					centroids[t * 3 + c] = (p0[c] + p1[c] + p2[c]) * (1.0f / 3);
+			}
+		});
+		float min[3];
+		float max[3];
+		ComputeBounds(centroids.data(), numTriangles, 3, min, max);
+		float scale[3];
+		for (int c = 0; c < 3; c++)
+			scale[c] = max[c] > min[c] ? 1023 / (max[c] - min[c]) : 0;
+
+		std::vector<uint32_t> codes(numTriangles);
+		std::vector<uint32_t> order(numTriangles);
+		ParallelBlocks(numTriangles, RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				codes[t] = MortonCode(&centroids[t * 3], min, scale);
+				order[t] = t;
+			}
+		});
+		RadixSort(codes, order, 30);
+
+		std::vector<uint32_t> sorted(numTriangles * 3);
+		ParallelBlocks(numTriangles, RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+				std::copy(&indices[order[t] * 3], &indices[order[t] * 3] + 3, &sorted[t * 3]);
+		});
+		std::copy(sorted.begin(), sorted.end(), indices);
+	}
+
+	// renumber the vertices of mesh in the order the indices first use them, every attribute
+	// along with the positions. vertices no triangle uses are dropped
+	void ReorderVerticesFirstUse(Mesh& mesh)
+	{
+		size_t numVertices = mesh.VertexCount();
+		std::vector<uint32_t> remap(numVertices, UINT32_MAX);
+		std::vector<uint32_t> order;
+		order.reserve(numVertices);
+		for (uint32_t& v : mesh.indices)
+		{
+			if (v >= numVertices)
+				continue;
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = order.size();
+				order.push_back(v);
+			}
+			v = remap[v];
+		}
+
+		auto reorder = [&](std::vector<float>& attribute, size_t components)
+		{
+			if (attribute.size() != numVertices * components)
+				return;
+			std::vector<float> out(order.size() * components);
+			ParallelBlocks(order.size(), RADIX_SORT_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+					std::copy(&attribute[order[v] * components], &attribute[order[v] * components] + components, &out[v * components]);
+			});
+			attribute = std::move(out);
+		};
+		reorder(mesh.positions, 3);
+		reorder(mesh.normals, 3);
+		reorder(mesh.texCoords, 2);
+	}
+
+	// morton order the triangles of every submesh, within its own index range, then the vertices
+	void SpatialOrderMesh(Mesh& mesh)
+	{
+		GetThreadPool().ParallelFor(mesh.submeshes.size(), [&](size_t i)
+		{
+			const Submesh& submesh = mesh.submeshes[i];
+			SortTrianglesMorton(mesh.positions.data(), 3, &mesh.indices[submesh.firstIndex], submesh.indexCount);
+		});
+		ReorderVerticesFirstUse(mesh);
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "mesh.h"
+#include "parse.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	constexpr size_t STL_HEADER_SIZE = 84;   // 80 byte comment and the triangle count
+	constexpr size_t STL_TRIANGLE_SIZE = 50; // normal, 3 corners and a 16 bit attribute
+
+	// a binary stl is recognised by its size matching the triangle count, ascii files
+	// start with "solid" but so do plenty of binary ones
+	bool IsBinaryStl(const char* data, size_t size)
+	{
+		if (size < STL_HEADER_SIZE)
+			return false;
+		uint32_t numTriangles;
+		memcpy(&numTriangles, data + 80, 4);
+		return STL_HEADER_SIZE + (uint64_t)numTriangles * STL_TRIANGLE_SIZE == size;
+	}
+
+	// stl has no vertex sharing, every triangle gets its own three vertices and its facet
+	// normal. that is the flat shading cad output expects, weld the mesh for smooth shading
+	void AddStlTriangle(const float* corners, const float* normal, float* positions, float* normals)
+	{
+		memcpy(positions, corners, 9 * sizeof(float));
+
+		float n[3] = {normal[0], normal[1], normal[2]};
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		// plenty of exporters write 0 normals, use the winding then
+		if (length == 0)
+		{
+			float e1[3], e2[3];
+			for (int i = 0; i < 3; i++)
+			{
+				e1[i] = corners[3 + i] - corners[i];
+				e2[i] = corners[6 + i] - corners[i];
+			}
+			n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+			length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		}
+		for (int i = 0; i < 3; i++)
+			n[i] = length > 0 ? n[i] / length : 0;
+		for (int corner = 0; corner < 3; corner++)
+			memcpy(normals + corner * 3, n, sizeof(n));
+	}
+
+	// the triangles are a fixed 50 bytes apart, so they are decoded in parallel
+	// straight out of the mapping
+	Mesh ParseBinaryStl(const char* data, size_t size)
+	{
+		Mesh mesh;
+		size_t numTriangles = (size - STL_HEADER_SIZE) / STL_TRIANGLE_SIZE;
+		mesh.positions.resize(numTriangles * 9);
+		mesh.normals.resize(numTriangles * 9);
+		mesh.indices.resize(numTriangles * 3);
+
+		const size_t blockSize = 1 << 14;
+		GetThreadPool().ParallelFor((numTriangles + blockSize - 1) / blockSize, [&](size_t block)
+		{
+			size_t end = std::min(numTriangles, (block + 1) * blockSize);
+			for (size_t tri = block * blockSize; tri < end; tri++)
+			{
+				// the records aren't 4 byte aligned
+				float record[12];
+				memcpy(record, data + STL_HEADER_SIZE + tri * STL_TRIANGLE_SIZE, sizeof(record));
+				AddStlTriangle(record + 3, record, &mesh.positions[tri * 9], &mesh.normals[tri * 9]);
+				for (uint32_t i = 0; i < 3; i++)
+					mesh.indices[tri * 3 + i] = tri * 3 + i;
+			}
+		});
+		return mesh;
+	}
+
+	// "facet normal ... outer loop vertex ... vertex ... vertex ... endloop endfacet"
+	Mesh ParseAsciiStl(const char* data, size_t size)
+	{
+		Mesh mesh;
+		float record[12] = {};
+		int numCorners = 0;
+		ForEachLine(data, data + size, [&](const char* begin, const char* end)
+		{
+			const char* p = SkipSpaces(begin, end);
+			const char* keyword = p;
+			p = SkipToken(p, end);
+			std::string key(keyword, p);
+
+			float* out;
+			if (key == "facet")
+			{
+				p = SkipToken(SkipSpaces(p, end), end); // "normal"
+				out = record;
+				numCorners = 0;
+			}
+			else if (key == "vertex" && numCorners < 3)
+				out = record + 3 + 3 * numCorners++;
+			else
+				return;
+
+			for (int i = 0; i < 3; i++)
+			{
+				p = SkipSpaces(p, end);
+				if (!ParseFloat(p, end, out[i]))
+					out[i] = 0;
+			}
+
+			if (key == "vertex" && numCorners == 3)
+			{
+				size_t first = mesh.positions.size() / 3;
+				mesh.positions.resize(mesh.positions.size() + 9);
+				mesh.normals.resize(mesh.normals.size() + 9);
+				AddStlTriangle(record + 3, record, &mesh.positions[first * 3], &mesh.normals[first * 3]);
+				for (uint32_t i = 0; i < 3; i++)
+					mesh.indices.push_back(first + i);
+			}
+		});
+		return mesh;
+	}
+
+	Mesh LoadStl(const char* filename)
+	{
+		MappedFile file;
+		if (!file.Open(filename))
+			return Mesh();
+		Mesh mesh = IsBinaryStl(file.Data(), file.Size()) ? ParseBinaryStl(file.Data(), file.Size()) : ParseAsciiStl(file.Data(), file.Size());
+		SetSingleSubmesh(mesh);
+		return mesh;
+	}
+}
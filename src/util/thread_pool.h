@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+
+	// a fixed set of worker threads that the parallel mesh passes share
+	class ThreadPool
+	{
+	public:
+		// 0 threads means one per hardware thread
+		explicit ThreadPool(unsigned numThreads = 0)
+		{
+			if (numThreads == 0)
+				numThreads = std::thread::hardware_concurrency();
+			if (numThreads == 0)
+				numThreads = 1;
+			m_iNumThreads = numThreads;
+
+			// the thread calling ParallelFor always works too, so spawn one less
+			for (unsigned i = 1; i < numThreads; i++)
+				m_workers.emplace_back([this] { WorkerLoop(); });
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_bStop = true;
+			}
+			m_cv.notify_all();
+			for (auto& worker : m_workers)
+				worker.join();
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		unsigned NumThreads() const { return m_iNumThreads; }
+
+		// run fn(i) for every i in [0, count) and wait for all of them.
+		// the caller takes part in the work, so it is safe to call from inside a task
+		template<typename F>
+		void ParallelFor(size_t count, F&& fn)
+		{
+			if (count == 0)
+				return;
+			if (count == 1 || m_workers.empty())
+			{
+				for (size_t i = 0; i < count; i++)
+					fn(i);
+				return;
+			}
+
+			struct State
+			{
+				std::atomic<size_t> next{0};
+				std::atomic<size_t> done{0};
+				std::mutex mutex;
+				std::condition_variable cv;
+			};
+			// helpers can be picked up after we return, they must not touch our stack then
+			auto state = std::make_shared<State>();
+			auto work = [state, count, &fn]()
+			{
+				size_t finished = 0;
+				for (size_t i; (i = state->next.fetch_add(1)) < count;)
+				{
+					fn(i);
+					finished++;
+				}
+				if (finished && state->done.fetch_add(finished) + finished == count)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->cv.notify_all();
+				}
+			};
+
+			size_t numHelpers = std::min(count - 1, m_workers.size());
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (size_t i = 0; i < numHelpers; i++)
+					m_tasks.push(work);
+			}
+			m_cv.notify_all();
+
+			work();
+
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->cv.wait(lock, [&] { return state->done.load() == count; });
+		}
+
+	private:
+		void WorkerLoop()
+		{
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_cv.wait(lock, [this] { return m_bStop || !m_tasks.empty(); });
+					if (m_bStop && m_tasks.empty())
+						return;
+					task = std::move(m_tasks.front());
+					m_tasks.pop();
+				}
+				task();
+			}
+		}
+
+		unsigned m_iNumThreads = 1;
+		std::vector<std::thread> m_workers;
+		std::queue<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_bStop = false;
+	};
+
+	static std::unique_ptr<ThreadPool> gs_pThreadPool;
+	static std::mutex gs_threadPoolMutex;
+
+	// the pool used by all parallel passes, created on first use
+	ThreadPool& GetThreadPool()
+	{
+		std::lock_guard<std::mutex> lock(gs_threadPoolMutex);
+		if (!gs_pThreadPool)
+			gs_pThreadPool.reset(new ThreadPool());
+		return *gs_pThreadPool;
+	}
+
+	// set how many threads the parallel passes use, 0 for one per hardware thread
+	// and 1 to run everything on the calling thread.
+	// must not be called while a parallel pass is running
+	void SetThreadCount(unsigned numThreads)
+	{
+		std::lock_guard<std::mutex> lock(gs_threadPoolMutex);
+		gs_pThreadPool.reset();
+		gs_pThreadPool.reset(new ThreadPool(numThreads));
+	}
+
+	// run fn(begin, end) over [0, count) in blocks on the shared pool. nothing runs for an
+	// empty range or blocks of size 0
+	template<typename F>
+	void ParallelBlocks(size_t count, size_t blockSize, F&& fn)
+	{
+		if (count == 0 || blockSize == 0)
+			return;
+		size_t numBlocks = (count + blockSize - 1) / blockSize;
+		GetThreadPool().ParallelFor(numBlocks, [&](size_t block)
+		{
+			fn(block * blockSize, std::min(count, (block + 1) * blockSize));
+		});
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace Util
+{
+
+	// the cpu writes one frame while the gpu may still read the two before it
+	constexpr uint32_t UNIFORM_RING_FRAMES = 3;
+
+	// one uniform buffer split into a region per frame in flight, every region fenced once the
+	// frame's draws are issued and waited on before it is written again. with ARB_buffer_storage
+	// it stays mapped and blocks are written straight into it, a plain 3.3 context gets each
+	// block through glBufferSubData into the same fenced regions so the driver never has to
+	// wait or copy behind the scenes
+	class UniformRing
+	{
+	public:
+		UniformRing() = default;
+		UniformRing(const UniformRing&) = delete;
+		UniformRing& operator=(const UniformRing&) = delete;
+		~UniformRing() { Destroy(); }
+
+		void Create(size_t frameBytes)
+		{
+			Destroy();
+			int alignment = 256;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			m_iAlignment = alignment;
+			m_iFrameBytes = Align(frameBytes);
+			size_t bytes = m_iFrameBytes * UNIFORM_RING_FRAMES;
+
+			glGenBuffers(1, &m_iBuffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, m_iBuffer);
+			if (GLEW_ARB_buffer_storage)
+			{
+				uint32_t flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_UNIFORM_BUFFER, bytes, nullptr, flags);
+				m_pMapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, bytes, flags);
+			}
+			else
+				glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+
+		void Destroy()
+		{
+			for (GLsync& fence : m_fences)
+			{
+				if (fence)
+					glDeleteSync(fence);
+				fence = nullptr;
+			}
+			if (m_iBuffer)
+				glDeleteBuffers(1, &m_iBuffer);
+			m_iBuffer = 0;
+			m_pMapped = nullptr;
+			m_iFrameBytes = 0;
+		}
+
+		// what size takes up in the ring, blocks have to start at the uniform buffer alignment
+		size_t Align(size_t size) const { return (size + m_iAlignment - 1) / m_iAlignment * m_iAlignment; }
+
+		// move to the next region and wait until the gpu is done with it. a frame needing more
+		// than a region gets a new buffer twice as big, the old one lives on in gl until its
+		// draws are done
+		void BeginFrame(size_t frameBytes)
+		{
+			if (!m_iBuffer || frameBytes > m_iFrameBytes)
+				Create(std::max(frameBytes, m_iFrameBytes * 2));
+			m_iFrame = (m_iFrame + 1) % UNIFORM_RING_FRAMES;
+			m_iHead = m_iFrame * m_iFrameBytes;
+			if (GLsync fence = m_fences[m_iFrame])
+			{
+				while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+					;
+				glDeleteSync(fence);
+				m_fences[m_iFrame] = nullptr;
+			}
+		}
+
+		// copy a block into this frame's region and bind it to binding for the draws that follow
+		bool Push(uint32_t binding, const void* data, size_t size)
+		{
+			size_t end = (m_iFrame + 1) * m_iFrameBytes;
+			if (m_iHead + size > end)
+			{
+				printf("Uniform ring is out of space for this frame\n");
+				return false;
+			}
+			if (m_pMapped)
+				memcpy(m_pMapped + m_iHead, data, size);
+			else
+			{
+				glBindBuffer(GL_UNIFORM_BUFFER, m_iBuffer);
+				glBufferSubData(GL_UNIFORM_BUFFER, m_iHead, size, data);
+			}
+			glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_iBuffer, m_iHead, size);
+			m_iHead += Align(size);
+			return true;
+		}
+
+		template<typename T>
+		bool Push(uint32_t binding, const T& block) { return Push(binding, &block, sizeof(T)); }
+
+		// after the frame's last draw, its region is free again once the gpu passes this point
+		void EndFrame()
+		{
+			if (m_iBuffer)
+				m_fences[m_iFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		bool IsPersistent() const { return m_pMapped != nullptr; }
+
+	private:
+		uint32_t m_iBuffer = 0;
+		char* m_pMapped = nullptr;
+		size_t m_iAlignment = 256;
+		size_t m_iFrameBytes = 0;
+		size_t m_iHead = 0;
+		uint32_t m_iFrame = 0;
+		GLsync m_fences[UNIFORM_RING_FRAMES] = {};
+	};
+}
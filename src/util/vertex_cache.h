@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	// the fifo the gpu keeps transformed vertices in, what the passes below optimize for
+	constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+	// how much worse than the cache order the overdraw order may make the acmr
+	constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+	struct VertexCacheStats
+	{
+		float acmr = 0; // vertices transformed per triangle, 0.5 at best and 3 at worst
+		float atvr = 0; // vertices transformed per vertex, 1 at best
+	};
+
+	// simulate a fifo of VERTEX_CACHE_SIZE over the index buffer
+	VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices)
+	{
+		VertexCacheStats stats;
+		if (numIndices < 3 || numVertices == 0)
+			return stats;
+
+		// a vertex is in the cache when it was pushed less than VERTEX_CACHE_SIZE misses ago
+		std::vector<size_t> pushedAt(numVertices, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < numIndices; i++)
+		{
+			uint32_t v = indices[i];
+			if (v >= numVertices)
+				continue;
+			if (pushedAt[v] == 0 || misses - pushedAt[v] >= VERTEX_CACHE_SIZE)
+				pushedAt[v] = ++misses;
+		}
+		stats.acmr = misses / (float)(numIndices / 3);
+		stats.atvr = misses / (float)numVertices;
+		return stats;
+	}
+
+	// renumber the vertices indices use to 0..n-1, global gets the original number of each,
+	// so a pass over a small part of a huge mesh only needs arrays for the vertices it touches
+	void CompactIndices(const uint32_t* indices, size_t numIndices, std::vector<uint32_t>& local, std::vector<uint32_t>& global)
+	{
+		global.assign(indices, indices + numIndices);
+		std::sort(global.begin(), global.end());
+		global.erase(std::unique(global.begin(), global.end()), global.end());
+		local.resize(numIndices);
+		for (size_t i = 0; i < numIndices; i++)
+			local[i] = std::lower_bound(global.begin(), global.end(), indices[i]) - global.begin();
+	}
+
+	// reorder the triangles of indices for the vertex cache with tipsify (Sander et al.
+	// "Fast triangle reordering for vertex locality and reduced overdraw"). every index must
+	// be below numVertices. clusters gets the first triangle of every run that starts with
+	// a cold cache, the places the triangles can be reordered at without hurting the cache much
+	void OptimizeVertexCache(uint32_t* indices, size_t numIndices, size_t numVertices, std::vector<uint32_t>& clusters)
+	{
+		size_t numTriangles = numIndices / 3;
+		clusters.clear();
+		if (numTriangles == 0)
+			return;
+
+		std::vector<uint32_t> offsets(numVertices + 1, 0);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+			offsets[indices[i] + 1]++;
+		for (size_t v = 0; v < numVertices; v++)
+			offsets[v + 1] += offsets[v];
+		std::vector<uint32_t> adjacency(offsets[numVertices]);
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < numTriangles * 3; i++)
+				adjacency[cursor[indices[i]]++] = i / 3;
+		}
+
+		std::vector<uint32_t> live(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			live[v] = offsets[v + 1] - offsets[v];
+		std::vector<uint32_t> cacheTime(numVertices, 0);
+		std::vector<bool> emitted(numTriangles, false);
+		std::vector<uint32_t> deadEnd;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> out;
+		out.reserve(numTriangles * 3);
+
+		const uint32_t k = VERTEX_CACHE_SIZE;
+		uint32_t time = k + 1;
+		size_t cursor = 1;
+		int64_t fan = 0;
+		clusters.push_back(0);
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+			{
+				uint32_t t = adjacency[a];
+				if (emitted[t])
+					continue;
+				emitted[t] = true;
+				for (int c = 0; c < 3; c++)
+				{
+					uint32_t v = indices[t * 3 + c];
+					out.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > k)
+						cacheTime[v] = time++;
+				}
+			}
+
+			// the candidate that will still be in the cache after its remaining triangles
+			// are emitted and has been there the longest
+			int64_t next = -1;
+			uint32_t best = 0;
+			for (uint32_t v : candidates)
+			{
+				if (live[v] == 0)
+					continue;
+				uint32_t priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= k)
+					priority = time - cacheTime[v];
+				if (next < 0 || priority > best)
+				{
+					best = priority;
+					next = v;
+				}
+			}
+
+			if (next < 0)
+			{
+				// dead end, go back to a recent vertex that still has triangles
+				while (!deadEnd.empty() && next < 0)
+				{
+					uint32_t v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v] > 0)
+						next = v;
+				}
+				// or any vertex at all
+				for (; next < 0 && cursor < numVertices; cursor++)
+				{
+					if (live[cursor] > 0)
+						next = cursor;
+				}
+			}
+
+			// a fan around a vertex that has left the cache starts a new cluster
+			if (next >= 0 && time - cacheTime[next] > k && out.size() / 3 != clusters.back())
+				clusters.push_back(out.size() / 3);
+			fan = next;
+		}
+
+		std::copy(out.begin(), out.end(), indices);
+	}
+
+	// sort the clusters OptimizeVertexCache found so the ones facing out of the mesh are drawn
+	// first, they tend to hide the rest (Sander et al., the same paper). positions are the first
+	// 3 floats of every stride floats. the cache order is kept when this costs too much acmr
+	void OptimizeOverdraw(uint32_t* indices, size_t numIndices, const float* vertices, size_t numVertices, size_t stride, const std::vector<uint32_t>& clusters)
+	{
+		size_t numTriangles = numIndices / 3;
+		if (clusters.size() < 2)
+			return;
+
+		auto position = [&](uint32_t v) { return vertices + v * stride; };
+
+		float meshCenter[3] = {0, 0, 0};
+		float meshArea = 0;
+		std::vector<float> keys(clusters.size());
+		std::vector<float> clusterCenters(clusters.size() * 3, 0.0f);
+		std::vector<float> clusterNormals(clusters.size() * 3, 0.0f);
+		std::vector<float> clusterAreas(clusters.size(), 0.0f);
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			size_t end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+			for (size_t t = clusters[c]; t < end; t++)
+			{
+				const float* p0 = position(indices[t * 3]);
+				const float* p1 = position(indices[t * 3 + 1]);
+				const float* p2 = position(indices[t * 3 + 2]);
+				float a[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+				float b[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+				float n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+				float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				for (int i = 0; i < 3; i++)
+				{
+					float center = (p0[i] + p1[i] + p2[i]) / 3;
+					clusterCenters[c * 3 + i] += center * area;
+					clusterNormals[c * 3 + i] += n[i];
+					meshCenter[i] += center * area;
+				}
+				clusterAreas[c] += area;
+				meshArea += area;
+			}
+		}
+		if (meshArea <= 0)
+			return;
+		for (int i = 0; i < 3; i++)
+			meshCenter[i] /= meshArea;
+
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			float* center = &clusterCenters[c * 3];
+			float* n = &clusterNormals[c * 3];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (clusterAreas[c] <= 0 || length <= 0)
+				continue;
+			float key = 0;
+			for (int i = 0; i < 3; i++)
+				key += (center[i] / clusterAreas[c] - meshCenter[i]) * n[i] / length;
+			keys[c] = key;
+		}
+
+		std::vector<uint32_t> order(clusters.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+		std::vector<uint32_t> sorted;
+		sorted.reserve(numTriangles * 3);
+		for (uint32_t c : order)
+		{
+			size_t end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+			sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + end * 3);
+		}
+
+		float before = AnalyzeVertexCache(indices, numTriangles * 3, numVertices).acmr;
+		float after = AnalyzeVertexCache(sorted.data(), sorted.size(), numVertices).acmr;
+		if (after <= before * OVERDRAW_THRESHOLD)
+			std::copy(sorted.begin(), sorted.end(), indices);
+	}
+
+	// renumber the vertices in the order the indices first use them so the vertex fetch
+	// walks memory forwards. vertices no triangle uses are dropped
+	void OptimizeVertexFetch(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices)
+	{
+		size_t numVertices = vertices.size() / stride;
+		std::vector<uint32_t> remap(numVertices, UINT32_MAX);
+		std::vector<float> out;
+		out.reserve(vertices.size());
+		uint32_t next = 0;
+		for (uint32_t& v : indices)
+		{
+			if (v >= numVertices)
+				continue;
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = next++;
+				out.insert(out.end(), &vertices[v * stride], &vertices[v * stride] + stride);
+			}
+			v = remap[v];
+		}
+		vertices = std::move(out);
+	}
+
+	// run all of the above on a mesh's interleaved vertex buffer and indices, each submesh
+	// on its own so their index ranges stay where they are
+	void OptimizeMesh(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes)
+	{
+		GetThreadPool().ParallelFor(submeshes.size(), [&](size_t i)
+		{
+			uint32_t* range = &indices[submeshes[i].firstIndex];
+			size_t count = submeshes[i].indexCount / 3 * 3;
+			std::vector<uint32_t> local;
+			std::vector<uint32_t> global;
+			CompactIndices(range, count, local, global);
+
+			std::vector<float> positions(global.size() * 3);
+			for (size_t v = 0; v < global.size(); v++)
+				std::copy(&vertices[global[v] * stride], &vertices[global[v] * stride] + 3, &positions[v * 3]);
+
+			std::vector<uint32_t> clusters;
+			OptimizeVertexCache(local.data(), count, global.size(), clusters);
+			OptimizeOverdraw(local.data(), count, positions.data(), global.size(), 3, clusters);
+			for (size_t k = 0; k < count; k++)
+				range[k] = global[local[k]];
+		});
+		OptimizeVertexFetch(vertices, stride, indices);
+	}
+}
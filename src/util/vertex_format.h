@@ -0,0 +1,388 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	constexpr size_t PACK_PARALLEL_BLOCK = 1 << 14;
+
+	// round to nearest even, out of range values become infinity
+	uint16_t FloatToHalf(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, 4);
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t exponent = (x >> 23) & 0xff;
+		uint32_t mantissa = x & 0x7fffff;
+		if (exponent == 0xff)
+			return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+		int32_t e = (int32_t)exponent - 127 + 15;
+		if (e >= 31)
+			return sign | 0x7c00;
+		if (e <= 0)
+		{
+			// denormal half
+			if (e < -10)
+				return sign;
+			mantissa |= 0x800000;
+			uint32_t shift = 14 - e;
+			uint32_t h = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (h & 1)))
+				h++;
+			return sign | h;
+		}
+		uint32_t h = ((uint32_t)e << 10) | (mantissa >> 13);
+		uint32_t rest = mantissa & 0x1fff;
+		// a carry out of the mantissa correctly bumps the exponent
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+			h++;
+		return sign | h;
+	}
+
+	int16_t QuantizeSnorm16(float f)
+	{
+		return (int16_t)std::lround(std::min(std::max(f, -1.0f), 1.0f) * 32767.0f);
+	}
+
+	// x, y and z in the low 30 bits as signed 10 bit values, w left 0
+	uint32_t PackInt1010102(const float* n)
+	{
+		uint32_t packed = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			int32_t v = (int32_t)std::lround(std::min(std::max(n[c], -1.0f), 1.0f) * 511.0f);
+			packed |= ((uint32_t)v & 0x3ff) << (c * 10);
+		}
+		return packed;
+	}
+
+	void PackOctahedral(const float* n, int16_t* out)
+	{
+		float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+		if (!(l1 > 0))
+		{
+			out[0] = 0;
+			out[1] = 0;
+			return;
+		}
+		float x = n[0] / l1;
+		float y = n[1] / l1;
+		if (n[2] < 0)
+		{
+			// fold the lower half over the diagonals
+			float fx = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+			float fy = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+			x = fx;
+			y = fy;
+		}
+		out[0] = QuantizeSnorm16(x);
+		out[1] = QuantizeSnorm16(y);
+	}
+
+	// the formats an attribute can be stored in. each one knows its size, how gl reads it,
+	// how to pack 3 floats into it and the glsl that turns it back into a vec3.
+	// packed formats are read as plain integers and scaled in the shader
+	struct f32
+	{
+		static constexpr uint32_t bytes = 12;
+		static constexpr int32_t components = 3;
+		static constexpr uint32_t glType = GL_FLOAT;
+		static constexpr bool quantized = false;
+		static constexpr const char* name = "float32";
+		static constexpr const char* glslType = "vec3";
+
+		static void Pack(const float* v, uint8_t* out, const float*, const float*) { memcpy(out, v, 12); }
+		static std::string Decode(const std::string& input, const std::string&) { return input; }
+	};
+
+	// 3 halves padded to keep the next attribute 4 byte aligned
+	struct f16
+	{
+		static constexpr uint32_t bytes = 8;
+		static constexpr int32_t components = 3;
+		static constexpr uint32_t glType = GL_HALF_FLOAT;
+		static constexpr bool quantized = false;
+		static constexpr const char* name = "float16";
+		static constexpr const char* glslType = "vec3";
+
+		static void Pack(const float* v, uint8_t* out, const float*, const float*)
+		{
+			uint16_t h[4] = {FloatToHalf(v[0]), FloatToHalf(v[1]), FloatToHalf(v[2]), 0};
+			memcpy(out, h, 8);
+		}
+		static std::string Decode(const std::string& input, const std::string&) { return input; }
+	};
+
+	// 16 bit integers across the mesh bounds, scale and offset come in as uniforms
+	struct snorm16
+	{
+		static constexpr uint32_t bytes = 8;
+		static constexpr int32_t components = 3;
+		static constexpr uint32_t glType = GL_SHORT;
+		static constexpr bool quantized = true;
+		static constexpr const char* name = "snorm16";
+		static constexpr const char* glslType = "vec3";
+
+		static void Pack(const float* v, uint8_t* out, const float* scale, const float* offset)
+		{
+			int16_t q[4] = {0, 0, 0, 0};
+			for (int c = 0; c < 3; c++)
+			{
+				float x = std::lround((v[c] - offset[c]) / scale[c]);
+				q[c] = (int16_t)std::min(std::max(x, -32767.0f), 32767.0f);
+			}
+			memcpy(out, q, 8);
+		}
+		static std::string Decode(const std::string& input, const std::string& uniform)
+		{
+			return input + " * " + uniform + "Scale + " + uniform + "Offset";
+		}
+	};
+
+	// GL_INT_2_10_10_10_REV, 10 bits per axis of a unit vector
+	struct packed1010102
+	{
+		static constexpr uint32_t bytes = 4;
+		static constexpr int32_t components = 4;
+		static constexpr uint32_t glType = GL_INT_2_10_10_10_REV;
+		static constexpr bool quantized = false;
+		static constexpr const char* name = "2_10_10_10";
+		static constexpr const char* glslType = "vec4";
+
+		static void Pack(const float* v, uint8_t* out, const float*, const float*)
+		{
+			uint32_t packed = PackInt1010102(v);
+			memcpy(out, &packed, 4);
+		}
+		static std::string Decode(const std::string& input, const std::string&) { return input + ".xyz / 511.0"; }
+	};
+
+	// a unit vector folded onto a square, 2 x 16 bit
+	struct oct16
+	{
+		static constexpr uint32_t bytes = 4;
+		static constexpr int32_t components = 2;
+		static constexpr uint32_t glType = GL_SHORT;
+		static constexpr bool quantized = false;
+		static constexpr const char* name = "octahedral16";
+		static constexpr const char* glslType = "vec2";
+
+		static void Pack(const float* v, uint8_t* out, const float*, const float*)
+		{
+			int16_t oct[2];
+			PackOctahedral(v, oct);
+			memcpy(out, oct, 4);
+		}
+		static std::string Decode(const std::string& input, const std::string&)
+		{
+			return "OctahedralDecode(" + input + " / 32767.0)";
+		}
+	};
+
+	// the attributes, what they are called in the shader and where they sit in the
+	// interleaved pos+normal floats meshes are kept in
+	template<typename Format>
+	struct Position
+	{
+		using format = Format;
+		static constexpr uint32_t location = 0;
+		static constexpr uint32_t source = 0;
+		static constexpr const char* label = "pos";
+		static constexpr const char* input = "aPos";
+		static constexpr const char* uniform = "position";
+		static constexpr const char* decode = "DecodePosition";
+	};
+
+	template<typename Format>
+	struct Normal
+	{
+		static_assert(!Format::quantized, "normals are unit vectors and are never scaled to the mesh bounds");
+		using format = Format;
+		static constexpr uint32_t location = 1;
+		static constexpr uint32_t source = 3;
+		static constexpr const char* label = "normal";
+		static constexpr const char* input = "aNormal";
+		static constexpr const char* uniform = "normal";
+		static constexpr const char* decode = "DecodeNormal";
+	};
+
+	// a vertex made of Attributes in order, e.g. Layout<Position<f16>, Normal<packed1010102>>.
+	// the stride, offsets, packing loop, gl attribute setup and shader inputs all come from
+	// the one description
+	template<typename... Attributes>
+	struct Layout
+	{
+		static constexpr uint32_t stride = (Attributes::format::bytes + ...);
+		static constexpr bool quantized = (Attributes::format::quantized || ...);
+
+		// fn(Attribute{}, byte offset) for every attribute in order
+		template<typename F>
+		static void ForEach(F&& fn)
+		{
+			uint32_t offset = 0;
+			((fn(Attributes{}, offset), offset += Attributes::format::bytes), ...);
+		}
+
+		// vertices [begin, end) of interleaved floats with srcStride floats each
+		static void Pack(const float* src, size_t srcStride, size_t begin, size_t end, uint8_t* dst, const float* scale, const float* offset)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const float* v = src + i * srcStride;
+				uint8_t* out = dst + i * stride;
+				ForEach([&](auto attribute, uint32_t at)
+				{
+					using A = decltype(attribute);
+					A::format::Pack(v + A::source, out + at, scale, offset);
+				});
+			}
+		}
+
+		// for the bound vao and vertex buffer
+		static void SetAttributes()
+		{
+			ForEach([](auto attribute, uint32_t at)
+			{
+				using A = decltype(attribute);
+				glVertexAttribPointer(A::location, A::format::components, A::format::glType, GL_FALSE, stride, (void*)(uintptr_t)at);
+				glEnableVertexAttribArray(A::location);
+			});
+		}
+
+		// the inputs and a vec3 DecodeX() for every attribute, goes after #version
+		static std::string ShaderInputs()
+		{
+			std::string out =
+				"uniform vec3 positionScale;"
+				"uniform vec3 positionOffset;"
+				"vec3 OctahedralDecode(vec2 e) {"
+				"	vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));"
+				"	float t = max(-n.z, 0);"
+				"	n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);"
+				"	return n;"
+				"}";
+			ForEach([&](auto attribute, uint32_t)
+			{
+				using A = decltype(attribute);
+				out += "layout (location = " + std::to_string(A::location) + ") in " + A::format::glslType + " " + A::input + ";";
+				out += std::string("vec3 ") + A::decode + "() { return " + A::format::Decode(A::input, A::uniform) + "; }";
+			});
+			return out;
+		}
+
+		static std::string Name()
+		{
+			std::string out;
+			ForEach([&](auto attribute, uint32_t)
+			{
+				using A = decltype(attribute);
+				out += std::string(out.empty() ? "" : " + ") + A::format::name + " " + A::label;
+			});
+			return out;
+		}
+	};
+
+	// a Layout with its functions taken out, so one can be picked at run time
+	struct VertexLayoutInfo
+	{
+		std::string name;
+		uint32_t stride;
+		bool quantized;
+		void (*pack)(const float* src, size_t srcStride, size_t begin, size_t end, uint8_t* dst, const float* scale, const float* offset);
+		void (*setAttributes)();
+		std::string shaderInputs;
+	};
+
+	template<typename L>
+	VertexLayoutInfo MakeVertexLayoutInfo()
+	{
+		return {L::Name(), L::stride, L::quantized, L::Pack, L::SetAttributes, L::ShaderInputs()};
+	}
+
+	// the layouts the viewer offers, the first one is what the model was loaded as before
+	const std::vector<VertexLayoutInfo>& GetVertexLayouts()
+	{
+		static const std::vector<VertexLayoutInfo> layouts = {
+			MakeVertexLayoutInfo<Layout<Position<f32>, Normal<f32>>>(),
+			MakeVertexLayoutInfo<Layout<Position<f16>, Normal<packed1010102>>>(),
+			MakeVertexLayoutInfo<Layout<Position<snorm16>, Normal<packed1010102>>>(),
+			MakeVertexLayoutInfo<Layout<Position<snorm16>, Normal<oct16>>>(),
+		};
+		return layouts;
+	}
+
+	// snorm16 positions + 2_10_10_10 normals, 12 bytes a vertex
+	constexpr uint32_t DEFAULT_VERTEX_LAYOUT = 2;
+
+	// a mesh converted to a vertex layout, ready to upload
+	struct PackedMesh
+	{
+		uint32_t layout = 0;
+		uint32_t stride = 0;
+		uint32_t indexSize = 4;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		std::vector<uint8_t> vertices;
+		std::vector<uint8_t> indices;
+		// the shader gets position * scale + offset back
+		float positionScale[3] = {1, 1, 1};
+		float positionOffset[3] = {0, 0, 0};
+	};
+
+	// convert interleaved pos+normal floats (stride in floats) to one of GetVertexLayouts.
+	// indices become 16 bit when every vertex can be addressed with them
+	PackedMesh PackMesh(const float* vertices, size_t numVertices, size_t stride, const uint32_t* indices, size_t numIndices, uint32_t layout)
+	{
+		const VertexLayoutInfo& info = GetVertexLayouts()[layout];
+		PackedMesh out;
+		out.layout = layout;
+		out.stride = info.stride;
+		out.vertexCount = numVertices;
+		out.indexCount = numIndices;
+		out.vertices.resize(numVertices * out.stride);
+
+		if (info.quantized && numVertices)
+		{
+			float boundsMin[3];
+			float boundsMax[3];
+			ComputeBounds(vertices, numVertices, stride, boundsMin, boundsMax);
+			for (int c = 0; c < 3; c++)
+			{
+				out.positionOffset[c] = (boundsMin[c] + boundsMax[c]) * 0.5f;
+				float extent = (boundsMax[c] - boundsMin[c]) * 0.5f;
+				out.positionScale[c] = extent > 0 ? extent / 32767.0f : 1;
+			}
+		}
+
+		ParallelBlocks(numVertices, PACK_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			info.pack(vertices, stride, begin, end, out.vertices.data(), out.positionScale, out.positionOffset);
+		});
+
+		if (numVertices <= 65536)
+		{
+			out.indexSize = 2;
+			out.indices.resize(numIndices * 2);
+			uint16_t* dst = (uint16_t*)out.indices.data();
+			for (size_t i = 0; i < numIndices; i++)
+				dst[i] = (uint16_t)indices[i];
+		}
+		else
+		{
+			out.indices.resize(numIndices * 4);
+			memcpy(out.indices.data(), indices, numIndices * 4);
+		}
+		return out;
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "index_map.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace Util
+{
+
+	// how close two positions have to be to become one, relative to the size of the mesh
+	constexpr float WELD_EPSILON = 1e-6f;
+	// normals and texture coordinates don't scale with the mesh. normals within about 0.8
+	// degrees of each other are the same, texture coordinates well under a texel of a 16k texture
+	constexpr float WELD_NORMAL_COSINE = 0.9999f;
+	constexpr float WELD_TEXCOORD_EPSILON = 1e-5f;
+	constexpr size_t WELD_PARALLEL_BLOCK = 1 << 14;
+
+	// vertices sorted into the cells of a grid 2 epsilon wide, hashed into a power of 2 buckets.
+	// everything within epsilon of a point is in at most 2 cells along each axis
+	class WeldGrid
+	{
+	public:
+		// epsilon must be above 0
+		void Build(const float* positions, size_t numVertices, float epsilon)
+		{
+			m_fEpsilon = epsilon;
+			m_dInvCellSize = 0.5 / epsilon;
+			size_t numBuckets = 1;
+			while (numBuckets < numVertices)
+				numBuckets *= 2;
+			m_iMask = numBuckets - 1;
+
+			// hashing is the expensive part, the counting sort after it is a few passes over
+			// an array and keeps every bucket in vertex order
+			std::vector<uint32_t> buckets(numVertices);
+			ParallelBlocks(numVertices, WELD_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+			{
+				for (size_t v = begin; v < end; v++)
+				{
+					const float* p = &positions[v * 3];
+					int64_t cell[3] = {Cell(p[0]), Cell(p[1]), Cell(p[2])};
+					buckets[v] = Bucket(cell);
+				}
+			});
+
+			m_offsets.assign(numBuckets + 1, 0);
+			for (uint32_t b : buckets)
+				m_offsets[b + 1]++;
+			for (size_t b = 0; b < numBuckets; b++)
+				m_offsets[b + 1] += m_offsets[b];
+			m_vertices.resize(numVertices);
+			std::vector<uint32_t> cursor(m_offsets.begin(), m_offsets.end() - 1);
+			for (size_t v = 0; v < numVertices; v++)
+				m_vertices[cursor[buckets[v]]++] = v;
+		}
+
+		// call fn(u) for every vertex in the cells within epsilon of p, and whatever shares their buckets
+		template<typename F>
+		void ForEachNear(const float* p, F&& fn) const
+		{
+			int64_t min[3];
+			int64_t max[3];
+			for (int c = 0; c < 3; c++)
+			{
+				min[c] = Cell((double)p[c] - m_fEpsilon);
+				// rounding can't stretch the range to more than 3 cells
+				max[c] = std::min(Cell((double)p[c] + m_fEpsilon), min[c] + 2);
+			}
+			uint64_t visited[27];
+			int numVisited = 0;
+			for (int64_t z = min[2]; z <= max[2]; z++)
+			{
+				for (int64_t y = min[1]; y <= max[1]; y++)
+				{
+					for (int64_t x = min[0]; x <= max[0]; x++)
+					{
+						int64_t cell[3] = {x, y, z};
+						uint64_t bucket = Bucket(cell);
+						// two neighbouring cells can hash to the same bucket
+						if (std::find(visited, visited + numVisited, bucket) != visited + numVisited)
+							continue;
+						visited[numVisited++] = bucket;
+						for (uint32_t i = m_offsets[bucket]; i < m_offsets[bucket + 1]; i++)
+							fn(m_vertices[i]);
+					}
+				}
+			}
+		}
+
+	private:
+		// far out cells are clamped together, that only costs a few more distance checks
+		int64_t Cell(double x) const
+		{
+			x = std::floor(x * m_dInvCellSize);
+			return x != x ? 0 : (int64_t)std::min(std::max(x, -4e18), 4e18);
+		}
+
+		uint64_t Bucket(const int64_t cell[3]) const
+		{
+			uint64_t h = HashMix((uint64_t)cell[0] * 0x9e3779b97f4a7c15ull ^ (uint64_t)cell[1] * 0xc2b2ae3d27d4eb4full ^ (uint64_t)cell[2]);
+			return h & m_iMask;
+		}
+
+		float m_fEpsilon = 1;
+		double m_dInvCellSize = 1;
+		uint64_t m_iMask = 0;
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_vertices;
+	};
+
+	// merge the vertices of mesh whose positions are closer than epsilon (an absolute distance).
+	// when the mesh has normals or texture coordinates those have to match too, within
+	// WELD_NORMAL_COSINE and WELD_TEXCOORD_EPSILON, so seams the file asked for stay. every
+	// vertex goes to the lowest numbered one it is welded with, so the result doesn't depend on
+	// the number of threads. returns how many vertices were merged away
+	size_t WeldMesh(Mesh& mesh, float epsilon)
+	{
+		size_t numVertices = mesh.VertexCount();
+		if (numVertices == 0)
+			return 0;
+		// exact duplicates only
+		epsilon = std::max(epsilon, FLT_MIN);
+		bool hasNormals = mesh.normals.size() == mesh.positions.size();
+		bool hasTexCoords = mesh.texCoords.size() == numVertices * 2;
+		float epsilon2 = epsilon * epsilon;
+
+		WeldGrid grid;
+		grid.Build(mesh.positions.data(), numVertices, epsilon);
+
+		// the lowest vertex within epsilon, which may in turn be welded to an even lower one
+		std::vector<uint32_t> remap(numVertices);
+		ParallelBlocks(numVertices, WELD_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; v++)
+			{
+				const float* p = &mesh.positions[v * 3];
+				uint32_t lowest = v;
+				grid.ForEachNear(p, [&](uint32_t u)
+				{
+					if (u >= lowest)
+						return;
+					const float* q = &mesh.positions[u * 3];
+					float d[3] = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+					if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > epsilon2)
+						return;
+					if (hasNormals)
+					{
+						// by angle, the files don't always have them normalized. a zero normal
+						// only matches another one
+						const float* n = &mesh.normals[v * 3];
+						const float* m = &mesh.normals[u * 3];
+						float nn = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+						float mm = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+						float nm = n[0] * m[0] + n[1] * m[1] + n[2] * m[2];
+						if (nn == 0 || mm == 0 ? nn != mm : nm < WELD_NORMAL_COSINE * std::sqrt(nn * mm))
+							return;
+					}
+					for (int c = 0; hasTexCoords && c < 2; c++)
+					{
+						if (std::fabs(mesh.texCoords[v * 2 + c] - mesh.texCoords[u * 2 + c]) > WELD_TEXCOORD_EPSILON)
+							return;
+					}
+					lowest = u;
+				});
+				remap[v] = lowest;
+			}
+		});
+
+		// follow the chains down, every lower vertex already points at where its chain ends.
+		// then number the vertices that are left in their old order
+		std::vector<uint32_t> newIndex(numVertices);
+		uint32_t next = 0;
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			remap[v] = remap[remap[v]];
+			if (remap[v] == v)
+				newIndex[v] = next++;
+		}
+		if (next == numVertices)
+			return 0;
+
+		auto compact = [&](std::vector<float>& attribute, size_t components)
+		{
+			if (attribute.size() != numVertices * components)
+				return;
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				if (remap[v] == v)
+					std::copy(&attribute[v * components], &attribute[v * components] + components, &attribute[newIndex[v] * components]);
+			}
+			attribute.resize(next * components);
+		};
+		compact(mesh.positions, 3);
+		compact(mesh.normals, 3);
+		compact(mesh.texCoords, 2);
+
+		ParallelBlocks(mesh.indices.size(), WELD_PARALLEL_BLOCK, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (mesh.indices[i] < numVertices)
+					mesh.indices[i] = newIndex[remap[mesh.indices[i]]];
+			}
+		});
+		return numVertices - next;
+	}
+}